@@ -0,0 +1,172 @@
+#include "allocator.h"
+#include <new>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define EZB_HAVE_MMAP
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+using namespace ezb;
+
+AllocationOptions::AllocationOptions() {
+    huge_pages = HUGE_PAGES_NONE;
+    numa_policy = NUMA_LOCAL;
+    numa_nodes = 0;
+    first_touch_threads = 0;
+}
+
+#ifdef EZB_HAVE_MMAP
+namespace {
+    const UINT64 SMALL_PAGE = 1ull << 12;
+
+    UINT64 page_size(const AllocationOptions &options) {
+        return options.huge_pages == HUGE_PAGES_1GB ? (1ull << 30) :
+               options.huge_pages == HUGE_PAGES_2MB ? (1ull << 21) : SMALL_PAGE;
+    }
+
+    /**
+     * Length of the mapping backing a buffer of the given size; explicit huge page mappings are rounded up to whole
+     * pages, and so are their fallbacks, so that release can unmap with the same length either way
+     */
+    UINT64 mapping_size(UINT64 bytes, const AllocationOptions &options) {
+        UINT64 page = page_size(options);
+        return (bytes + page - 1) & ~(page - 1);
+    }
+
+    /**
+     * Writes one byte into every page of [buffer + from, buffer + to) from several threads, so that the pages are
+     * faulted in by the threads in parallel and placed by the first-touch policy of the kernel
+     */
+    void first_touch(char *buffer, UINT64 from, UINT64 to, const AllocationOptions &options) {
+        if (from >= to) {
+            return;
+        }
+        UINT64 page = page_size(options);
+        UINT64 no_pages = (to - from + page - 1) / page;
+        UINT64 no_threads = options.first_touch_threads < no_pages ? options.first_touch_threads : no_pages;
+        if (no_threads < 2) {
+            return;
+        }
+        std::vector<std::thread> workers;
+        UINT64 pages_per_thread = (no_pages + no_threads - 1) / no_threads;
+        for (UINT64 t = 0; t < no_threads; t++) {
+            UINT64 first = from + t * pages_per_thread * page;
+            UINT64 last = first + pages_per_thread * page < to ? first + pages_per_thread * page : to;
+            workers.emplace_back([buffer, first, last, page]() {
+                for (UINT64 offset = first; offset < last; offset += page) {
+                    reinterpret_cast<volatile char *>(buffer)[offset] = 0;
+                }
+            });
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+     * Applies the huge page advice and the NUMA policy to the whole mapping and first-touches the pages starting in
+     * [from, bytes)
+     */
+    void place(void *buffer, UINT64 from, UINT64 bytes, const AllocationOptions &options) {
+        UINT64 length = mapping_size(bytes, options);
+#ifdef __linux__
+        if (options.huge_pages != HUGE_PAGES_NONE) { // no-op on explicit huge page mappings
+            madvise(buffer, length, MADV_HUGEPAGE);
+        }
+        if (options.numa_policy != NUMA_LOCAL) {
+            const int MPOL_BIND_MODE = 2, MPOL_INTERLEAVE_MODE = 3, MPOL_F_MEMS_ALLOWED_FLAG = 1 << 2;
+            unsigned long nodes = options.numa_nodes;
+            if (!nodes) { // all nodes the process may allocate from
+                int mode;
+                syscall(SYS_get_mempolicy, &mode, &nodes, sizeof(nodes) * 8, nullptr, MPOL_F_MEMS_ALLOWED_FLAG);
+            }
+            syscall(SYS_mbind, buffer, length,
+                    options.numa_policy == NUMA_INTERLEAVE ? MPOL_INTERLEAVE_MODE : MPOL_BIND_MODE,
+                    &nodes, sizeof(nodes) * 8 + 1, 0);
+        }
+#endif
+        // starts at the first page boundary at or after from, as the bytes before it may hold data
+        first_touch(static_cast<char *>(buffer), (from + SMALL_PAGE - 1) & ~(SMALL_PAGE - 1), bytes, options);
+    }
+
+    void *map_zeroed(UINT64 bytes, const AllocationOptions &options) {
+        UINT64 length = mapping_size(bytes, options);
+        void *buffer = MAP_FAILED;
+#if defined(__linux__) && defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB) && defined(MAP_HUGE_1GB)
+        if (options.huge_pages == HUGE_PAGES_2MB || options.huge_pages == HUGE_PAGES_1GB) {
+            buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                          (options.huge_pages == HUGE_PAGES_1GB ? MAP_HUGE_1GB : MAP_HUGE_2MB), -1, 0);
+        }
+#endif
+        if (buffer == MAP_FAILED) { // regular pages, or no explicit huge pages reserved
+            buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (buffer == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        place(buffer, 0, bytes, options);
+        return buffer;
+    }
+}
+#endif
+
+void *ezb::allocate_zeroed(UINT64 bytes, const AllocationOptions &options) {
+#ifdef EZB_HAVE_MMAP
+    if (bytes >= EZB_MMAP_THRESHOLD) { // anonymous mappings are zero-filled on first touch
+        return map_zeroed(bytes, options);
+    }
+#endif
+    void *buffer = calloc(bytes ? bytes : 1, 1);
+    if (!buffer) {
+        throw std::bad_alloc();
+    }
+    return buffer;
+}
+
+void *ezb::reallocate_zeroed(void *buffer, UINT64 old_bytes, UINT64 new_bytes, const AllocationOptions &options) {
+#ifdef EZB_HAVE_MMAP
+    if (new_bytes >= EZB_MMAP_THRESHOLD) {
+#ifdef __linux__
+        if (old_bytes >= EZB_MMAP_THRESHOLD && page_size(options) == SMALL_PAGE) {
+            // move the pages of the mapping instead of copying, the tail is zero
+            void *grown = mremap(buffer, mapping_size(old_bytes, options), mapping_size(new_bytes, options),
+                                 MREMAP_MAYMOVE);
+            if (grown == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            place(grown, old_bytes, new_bytes, options);
+            return grown;
+        }
+#endif
+        void *grown = allocate_zeroed(new_bytes, options);
+        memcpy(grown, buffer, old_bytes);
+        release(buffer, old_bytes, options);
+        return grown;
+    }
+#endif
+    void *grown = realloc(buffer, new_bytes ? new_bytes : 1);
+    if (!grown) {
+        throw std::bad_alloc();
+    }
+    memset(static_cast<char *>(grown) + old_bytes, 0, new_bytes - old_bytes);
+    return grown;
+}
+
+void ezb::release(void *buffer, UINT64 bytes, const AllocationOptions &options) {
+    if (!buffer) {
+        return;
+    }
+#ifdef EZB_HAVE_MMAP
+    if (bytes >= EZB_MMAP_THRESHOLD) {
+        munmap(buffer, mapping_size(bytes, options));
+        return;
+    }
+#endif
+    free(buffer);
+}
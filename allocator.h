@@ -0,0 +1,96 @@
+#ifndef EZBITSTREAM_ALLOCATOR_H
+#define EZBITSTREAM_ALLOCATOR_H
+#include "ezbitstream.h"
+
+/**
+ * Size in bytes from which buffers are backed by anonymous memory mappings instead of the heap. The kernel hands out
+ * zero pages for mappings lazily, so allocating or growing a large zeroed buffer neither writes nor commits memory
+ * for regions that are never touched
+ */
+#ifndef EZB_MMAP_THRESHOLD
+#define EZB_MMAP_THRESHOLD (1ull << 20)
+#endif
+
+namespace ezb {
+    /**
+     * Page size requested for mapped buffers
+     */
+    enum HugePageMode {
+        HUGE_PAGES_NONE,        // regular pages
+        HUGE_PAGES_TRANSPARENT, // regular mapping advised with MADV_HUGEPAGE, promoted by the kernel when possible
+        HUGE_PAGES_2MB,         // explicit 2 MB pages through MAP_HUGETLB, falls back to transparent huge pages
+        HUGE_PAGES_1GB          // explicit 1 GB pages through MAP_HUGETLB, falls back to transparent huge pages
+    };
+
+    /**
+     * NUMA placement of mapped buffers
+     */
+    enum NumaPolicy {
+        NUMA_LOCAL,      // kernel default, pages land on the node of the thread touching them first
+        NUMA_INTERLEAVE, // pages are spread round robin over the nodes in numa_nodes
+        NUMA_BIND        // pages are allocated only from the nodes in numa_nodes
+    };
+
+    /**
+     * Placement options for buffers of at least EZB_MMAP_THRESHOLD bytes, smaller buffers ignore them. Options that
+     * the platform does not support are ignored as well
+     */
+    struct AllocationOptions {
+        HugePageMode huge_pages;
+        NumaPolicy numa_policy;
+        UINT64 numa_nodes;          // bit mask of the nodes used by the NUMA policy, 0 for all nodes allowed
+        UINT32 first_touch_threads; // if more than 1, newly mapped pages are touched in parallel by as many threads
+
+        AllocationOptions();
+    };
+
+    /**
+     * Allocates a zero-initialized buffer, throws std::bad_alloc on failure
+     * @param bytes Size of the buffer in bytes
+     * @param options Placement of the buffer if it is mapped
+     * @return Pointer to the buffer, to be released with release
+     */
+    void *allocate_zeroed(UINT64 bytes, const AllocationOptions &options = AllocationOptions());
+
+    /**
+     * Grows a buffer obtained from allocate_zeroed, the contents are preserved and the new tail is zero. Mapped
+     * buffers are grown by remapping where the platform supports it, without copying
+     * @param buffer Buffer to be grown
+     * @param old_bytes Current size of the buffer in bytes
+     * @param new_bytes New size of the buffer in bytes, not less than old_bytes
+     * @param options Placement options the buffer was allocated with
+     * @return Pointer to the grown buffer, buffer is invalidated
+     */
+    void *reallocate_zeroed(void *buffer, UINT64 old_bytes, UINT64 new_bytes,
+                            const AllocationOptions &options = AllocationOptions());
+
+    /**
+     * Releases a buffer obtained from allocate_zeroed or reallocate_zeroed
+     * @param buffer Buffer to be released, may be null
+     * @param bytes Size of the buffer in bytes, as passed on allocation
+     * @param options Placement options the buffer was allocated with
+     */
+    void release(void *buffer, UINT64 bytes, const AllocationOptions &options = AllocationOptions());
+
+    /**
+     * Word-typed helpers over the functions above, sizes are in words. Buffers handed out by flush are allocated with
+     * allocate_words and must be released with release_words(buffer, size), passing the allocation options of the
+     * stream if it was constructed with any
+     */
+    template<typename T>
+    inline T *allocate_words(UINT64 no_words, const AllocationOptions &options = AllocationOptions()) {
+        return static_cast<T *>(allocate_zeroed(no_words * sizeof(T), options));
+    }
+
+    template<typename T>
+    inline T *reallocate_words(T *buffer, UINT64 old_no_words, UINT64 new_no_words,
+                               const AllocationOptions &options = AllocationOptions()) {
+        return static_cast<T *>(reallocate_zeroed(buffer, old_no_words * sizeof(T), new_no_words * sizeof(T), options));
+    }
+
+    template<typename T>
+    inline void release_words(T *buffer, UINT64 no_words, const AllocationOptions &options = AllocationOptions()) {
+        release(buffer, no_words * sizeof(T), options);
+    }
+}
+#endif //EZBITSTREAM_ALLOCATOR_H
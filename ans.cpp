@@ -0,0 +1,344 @@
+#include "ans.h"
+#include "allocator.h"
+#include "bit_ops.h"
+using namespace ezb;
+
+namespace {
+    // states are kept in [2^15, 2^31), below which the quotient by the reciprocal of a frequency is exact
+    const UINT64 RANS_LOWER_BOUND = 1ull << 15;
+    const UINT32 RANS_STATES = 4;
+    const UINT32 TANS_STATES = 2;
+
+    /**
+     * Gathers the bits output by an encoder in a register and hands them to the writer 32 at a time
+     */
+    class BitBuffer {
+    public:
+        explicit BitBuffer(BitWriter &writer) : m_writer(writer), m_bits(0), m_count(0) {
+        }
+
+        /**
+         * Appends the lower no_bits bits of value, no_bits being at most 32
+         */
+        inline void put(UINT64 value, UINT64 no_bits) {
+            m_bits |= (value & MASK_SHIFT_64_RIGHT[64 - no_bits]) << m_count;
+            m_count += no_bits;
+            if (m_count >= 32) {
+                m_writer.write(m_bits, 32);
+                m_bits >>= 32;
+                m_count -= 32;
+            }
+        }
+
+        inline void flush() {
+            m_writer.write(m_bits, (UINT8) m_count);
+            m_bits = 0;
+            m_count = 0;
+        }
+
+    private:
+        BitWriter &m_writer;
+        UINT64 m_bits;
+        UINT64 m_count;
+    };
+
+    /**
+     * Codes a symbol with a tANS state, outputting the lower bits of the state
+     */
+    template<typename SymbolTransform>
+    inline void tans_step(UINT64 &state, const SymbolTransform &transform, const UINT16 *states, BitBuffer &output) {
+        UINT64 no_bits = (UINT32) (state + transform.delta_bits) >> 16;
+        output.put(state, no_bits);
+        state = states[(state >> no_bits) + transform.delta_state];
+    }
+
+    /**
+     * Codes a symbol with a rANS state, outputting its lower 16 bits first if the result would not fit in 31 bits
+     */
+    template<typename EncodeSymbol>
+    inline void rans_encode_step(UINT64 &state, const EncodeSymbol &symbol, BitBuffer &output) {
+        UINT64 no_bits = state >= symbol.upper_bound ? 16 : 0;
+        output.put(state, no_bits);
+        state >>= no_bits;
+        // state / frequency by multiplying with the reciprocal, then state << scale_bits + state % frequency + start
+        UINT64 quotient = ((state * symbol.reciprocal) >> 32) >> symbol.shift;
+        state += symbol.bias + quotient * symbol.complement;
+    }
+
+    /**
+     * Decodes the symbol of a rANS state and moves the state to the previous one, reading 16 bits if it falls below the
+     * lower bound. The renormalization does not branch, its outcome being as good as random
+     */
+    template<typename SlotEntry>
+    inline UINT8 rans_decode_step(UINT64 &state, const SlotEntry *slots, UINT64 mask, UINT64 scale_bits,
+                           BackwardBitReader &input) {
+        const SlotEntry &entry = slots[state & mask];
+        state = entry.frequency * (state >> scale_bits) + entry.offset;
+        UINT8 no_bits = state < RANS_LOWER_BOUND ? 16 : 0;
+        state = (state << no_bits) | input.read(no_bits);
+        return entry.symbol;
+    }
+
+    inline UINT64 high_bit(UINT64 value) {
+        return 63 - leading_zeros(value);
+    }
+
+    /**
+     * Spreads the symbols over the 1 << table_log slots of a tANS table, as FSE does: the step is odd, hence visits
+     * every slot once, and scatters the slots of a symbol over the table
+     */
+    void spread_symbols(const UINT32 *frequencies, UINT32 no_symbols, UINT8 table_log, UINT8 *slots) {
+        UINT64 table_size = 1ull << table_log;
+        UINT64 step = (table_size >> 1) + (table_size >> 3) + 3;
+        UINT64 position = 0;
+        for (UINT32 s = 0; s < no_symbols; s++) {
+            for (UINT32 i = 0; i < frequencies[s]; i++) {
+                slots[position] = (UINT8) s;
+                position = (position + step) & (table_size - 1);
+            }
+        }
+    }
+}
+
+bool ezb::normalize_frequencies(const UINT64 *counts, UINT32 no_symbols, UINT8 table_log, UINT32 *frequencies) {
+    if (!no_symbols) {
+        return false;
+    }
+    UINT64 table_size = 1ull << table_log;
+    UINT64 total = 0;
+    UINT64 occurring = 0;
+    UINT32 largest = 0;
+    for (UINT32 s = 0; s < no_symbols; s++) {
+        total += counts[s];
+        occurring += counts[s] != 0;
+        largest = counts[s] > counts[largest] ? s : largest;
+    }
+    if (!total || occurring > table_size) {
+        return false;
+    }
+    UINT64 assigned = 0;
+    for (UINT32 s = 0; s < no_symbols; s++) {
+        UINT64 frequency = (UINT64) ((double) counts[s] * table_size / total);
+        frequencies[s] = counts[s] ? (UINT32) (frequency ? frequency : 1) : 0;
+        assigned += frequencies[s];
+    }
+    if (assigned <= table_size) { // rounding down leaves slots, given to the most frequent symbol
+        frequencies[largest] += (UINT32) (table_size - assigned);
+        return true;
+    }
+    // symbols raised to 1 took too many slots, take them back from the most frequent symbols a quarter at most at a time
+    UINT64 excess = assigned - table_size;
+    while (excess) {
+        UINT32 most = 0;
+        for (UINT32 s = 1; s < no_symbols; s++) {
+            most = frequencies[s] > frequencies[most] ? s : most;
+        }
+        UINT64 take = (frequencies[most] + 3) >> 2;
+        take = take < frequencies[most] - 1 ? take : frequencies[most] - 1;
+        take = take < excess ? take : excess;
+        frequencies[most] -= (UINT32) take;
+        excess -= take;
+    }
+    return true;
+}
+
+TansEncoder::TansEncoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 table_log) {
+    UINT64 table_size = 1ull << table_log;
+    m_table_log = table_log;
+    m_states = allocate_words<UINT16>(table_size);
+    UINT8 *slots = allocate_words<UINT8>(table_size);
+    spread_symbols(frequencies, no_symbols, table_log, slots);
+    UINT64 starts[ANS_MAX_SYMBOLS];
+    UINT64 start = 0;
+    for (UINT32 s = 0; s < ANS_MAX_SYMBOLS; s++) {
+        UINT64 frequency = s < no_symbols ? frequencies[s] : 0;
+        starts[s] = start;
+        if (frequency == 1) {
+            m_transforms[s].delta_bits = (UINT32) ((table_log << 16) - table_size);
+        } else if (frequency) {
+            UINT64 max_bits = table_log - high_bit(frequency - 1);
+            m_transforms[s].delta_bits = (UINT32) ((max_bits << 16) - (frequency << max_bits));
+        } else {
+            m_transforms[s].delta_bits = 0;
+        }
+        m_transforms[s].delta_state = start - frequency;
+        start += frequency;
+    }
+    for (UINT64 slot = 0; slot < table_size; slot++) { // the states reaching each slot, by symbol in slot order
+        m_states[starts[slots[slot]]++] = (UINT16) (table_size + slot);
+    }
+    release_words(slots, table_size);
+}
+
+TansEncoder::~TansEncoder() {
+    release_words(m_states, 1ull << m_table_log);
+}
+
+void TansEncoder::encode(const UINT8 *symbols, UINT64 no_symbols, BitWriter &writer) {
+    BitBuffer output(writer);
+    const UINT16 *states = m_states;
+    const SymbolTransform *transforms = m_transforms;
+    UINT64 table_log = m_table_log;
+    UINT64 state0 = 1ull << table_log, state1 = 1ull << table_log;
+    UINT64 i = no_symbols;
+    if (i & 1) { // the last symbol has an even index
+        i--;
+        tans_step(state0, transforms[symbols[i]], states, output);
+    }
+    for (; i; i -= TANS_STATES) {
+        tans_step(state1, transforms[symbols[i - 1]], states, output);
+        tans_step(state0, transforms[symbols[i - 2]], states, output);
+    }
+    output.put(state1, table_log);
+    output.put(state0, table_log);
+    output.flush();
+}
+
+TansDecoder::TansDecoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 table_log) {
+    UINT64 table_size = 1ull << table_log;
+    m_table_log = table_log;
+    m_table = allocate_words<DecodeEntry>(table_size);
+    UINT8 *slots = allocate_words<UINT8>(table_size);
+    spread_symbols(frequencies, no_symbols, table_log, slots);
+    UINT64 next[ANS_MAX_SYMBOLS];
+    for (UINT32 s = 0; s < no_symbols; s++) {
+        next[s] = frequencies[s];
+    }
+    for (UINT64 slot = 0; slot < table_size; slot++) {
+        UINT8 symbol = slots[slot];
+        UINT64 state = next[symbol]++;
+        UINT64 no_bits = table_log - high_bit(state);
+        m_table[slot].base = (UINT16) ((state << no_bits) - table_size);
+        m_table[slot].symbol = symbol;
+        m_table[slot].no_bits = (UINT8) no_bits;
+    }
+    release_words(slots, table_size);
+}
+
+TansDecoder::~TansDecoder() {
+    release_words(m_table, 1ull << m_table_log);
+}
+
+bool TansDecoder::decode(BackwardBitReader &reader, UINT8 *symbols, UINT64 no_symbols) {
+    BackwardBitReader input = reader; // a local copy stays in registers, the stores of the symbols could alias reader
+    const DecodeEntry *table = m_table;
+    input.refill();
+    UINT64 state0 = input.read(m_table_log);
+    UINT64 state1 = input.read(m_table_log);
+    UINT64 i = 0;
+    for (; i + TANS_STATES <= no_symbols; i += TANS_STATES) {
+        input.refill();
+        DecodeEntry entry0 = table[state0];
+        DecodeEntry entry1 = table[state1];
+        symbols[i] = entry0.symbol;
+        symbols[i + 1] = entry1.symbol;
+        state0 = entry0.base + input.read(entry0.no_bits);
+        state1 = entry1.base + input.read(entry1.no_bits);
+    }
+    if (i < no_symbols) {
+        input.refill();
+        DecodeEntry entry0 = table[state0];
+        symbols[i] = entry0.symbol;
+        state0 = entry0.base + input.read(entry0.no_bits);
+    }
+    reader = input;
+    return state0 == 0 && state1 == 0 && !input.overflowed();
+}
+
+RansEncoder::RansEncoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 scale_bits) {
+    m_scale_bits = scale_bits;
+    UINT64 start = 0;
+    for (UINT32 s = 0; s < ANS_MAX_SYMBOLS; s++) {
+        UINT64 frequency = s < no_symbols ? frequencies[s] : 0;
+        EncodeSymbol &symbol = m_symbols[s];
+        symbol.upper_bound = frequency << (31 - scale_bits);
+        symbol.complement = (UINT32) ((1ull << scale_bits) - frequency);
+        if (frequency < 2) { // the reciprocal makes q = state - 1, and the bias completes state << scale_bits + start
+            symbol.reciprocal = ~0u;
+            symbol.shift = 0;
+            symbol.bias = (UINT32) (start + (1ull << scale_bits) - 1);
+        } else {
+            UINT64 shift = high_bit(frequency - 1) + 1;
+            symbol.reciprocal = (UINT32) (((1ull << (shift + 31)) + frequency - 1) / frequency);
+            symbol.shift = (UINT32) (shift - 1);
+            symbol.bias = (UINT32) start;
+        }
+        start += frequency;
+    }
+}
+
+void RansEncoder::encode(const UINT8 *symbols, UINT64 no_symbols, BitWriter &writer) {
+    BitBuffer output(writer);
+    const EncodeSymbol *coding = m_symbols;
+    UINT64 states[RANS_STATES] = {RANS_LOWER_BOUND, RANS_LOWER_BOUND, RANS_LOWER_BOUND, RANS_LOWER_BOUND};
+    UINT64 i = no_symbols;
+    for (; i & (RANS_STATES - 1); i--) { // the symbols past the last multiple of 4
+        rans_encode_step(states[(i - 1) & (RANS_STATES - 1)], coding[symbols[i - 1]], output);
+    }
+    UINT64 state0 = states[0], state1 = states[1], state2 = states[2], state3 = states[3];
+    for (; i; i -= RANS_STATES) {
+        rans_encode_step(state3, coding[symbols[i - 1]], output);
+        rans_encode_step(state2, coding[symbols[i - 2]], output);
+        rans_encode_step(state1, coding[symbols[i - 3]], output);
+        rans_encode_step(state0, coding[symbols[i - 4]], output);
+    }
+    output.put(state3, 32);
+    output.put(state2, 32);
+    output.put(state1, 32);
+    output.put(state0, 32);
+    output.flush();
+}
+
+RansDecoder::RansDecoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 scale_bits) {
+    m_scale_bits = scale_bits;
+    m_slots = allocate_words<SlotEntry>(1ull << scale_bits);
+    UINT64 slot = 0;
+    for (UINT32 s = 0; s < no_symbols; s++) {
+        for (UINT32 i = 0; i < frequencies[s]; i++, slot++) {
+            m_slots[slot].frequency = frequencies[s];
+            m_slots[slot].offset = (UINT16) i;
+            m_slots[slot].symbol = (UINT8) s;
+        }
+    }
+}
+
+RansDecoder::~RansDecoder() {
+    release_words(m_slots, 1ull << m_scale_bits);
+}
+
+bool RansDecoder::decode(BackwardBitReader &reader, UINT8 *symbols, UINT64 no_symbols) {
+    BackwardBitReader input = reader;
+    const SlotEntry *slots = m_slots;
+    UINT64 scale_bits = m_scale_bits;
+    UINT64 mask = (1ull << scale_bits) - 1;
+    UINT64 states[RANS_STATES];
+    for (UINT32 k = 0; k < RANS_STATES; k++) { // a refill only guarantees 57 bits, one state at a time
+        input.refill();
+        states[k] = input.read(32);
+    }
+    // four states in separate registers, so that their steps are independent chains
+    UINT64 state0 = states[0], state1 = states[1], state2 = states[2], state3 = states[3];
+    UINT64 i = 0;
+    for (; i + RANS_STATES <= no_symbols; i += RANS_STATES) { // at most two 16-bit words between refills
+        input.refill();
+        symbols[i] = rans_decode_step(state0, slots, mask, scale_bits, input);
+        symbols[i + 1] = rans_decode_step(state1, slots, mask, scale_bits, input);
+        input.refill();
+        symbols[i + 2] = rans_decode_step(state2, slots, mask, scale_bits, input);
+        symbols[i + 3] = rans_decode_step(state3, slots, mask, scale_bits, input);
+    }
+    states[0] = state0;
+    states[1] = state1;
+    states[2] = state2;
+    states[3] = state3;
+    for (UINT32 k = 0; i < no_symbols; i++, k++) {
+        input.refill();
+        symbols[i] = rans_decode_step(states[k], slots, mask, scale_bits, input);
+    }
+    bool initial = true;
+    for (UINT32 k = 0; k < RANS_STATES; k++) {
+        initial &= states[k] == RANS_LOWER_BOUND;
+    }
+    reader = input;
+    return initial && !input.overflowed();
+}
@@ -0,0 +1,153 @@
+#ifndef EZBITSTREAM_ANS_H
+#define EZBITSTREAM_ANS_H
+#include "ezbitstream.h"
+#include "bit_writer.h"
+#include "bit_reader.h"
+
+/**
+ * Entropy coders of the asymmetric numeral systems family over byte symbols. The encoders take the symbols from last to
+ * first and append their bits with a BitWriter, and the decoders read them back from the end of the stream with a
+ * BackwardBitReader, producing the symbols from first to last. Both sides are built from the same frequencies, see
+ * normalize_frequencies; storing them next to the coded bits is left to the caller.
+ *
+ *   tANS   table driven (FSE), two interleaved states, bits of variable length per symbol
+ *   rANS   four interleaved states with 16-bit renormalization, so that the decoding steps of consecutive symbols are
+ *          independent and overlap in the pipeline
+ */
+namespace ezb {
+    const UINT8 ANS_MIN_TABLE_LOG = 5;
+    const UINT8 ANS_MAX_TABLE_LOG = 15;
+    const UINT32 ANS_MAX_SYMBOLS = 256;
+
+    /**
+     * Scales the counts of the symbols to frequencies summing to 1 << table_log, every symbol occurring getting a
+     * frequency of at least 1
+     * @param counts Number of occurrences of each of the no_symbols symbols
+     * @param no_symbols Size of the alphabet, at most ANS_MAX_SYMBOLS
+     * @param table_log Log2 of the sum of the frequencies, between ANS_MIN_TABLE_LOG and ANS_MAX_TABLE_LOG
+     * @param frequencies Buffer of no_symbols entries receiving the frequencies
+     * @return False if no symbol occurs or more symbols occur than 1 << table_log
+     */
+    bool normalize_frequencies(const UINT64 *counts, UINT32 no_symbols, UINT8 table_log, UINT32 *frequencies);
+
+    /**
+     * Defines a tANS encoder with two interleaved states, symbol i being coded by state i % 2, the symbols being spread
+     * over the table as in FSE
+     */
+    class TansEncoder {
+    public:
+        /**
+         * @param frequencies Frequencies of the no_symbols symbols, summing to 1 << table_log
+         */
+        TansEncoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 table_log);
+        ~TansEncoder();
+        TansEncoder(const TansEncoder &other) = delete;
+        TansEncoder &operator=(const TansEncoder &other) = delete;
+
+        /**
+         * Encodes the no_symbols symbols, each of non-zero frequency, appending their bits and the final state to
+         * writer
+         */
+        void encode(const UINT8 *symbols, UINT64 no_symbols, BitWriter &writer);
+
+    private:
+        struct SymbolTransform {
+            UINT32 delta_bits;  // added to the state, the upper 16 bits of the sum are the number of bits to output
+            UINT64 delta_state; // added, modulo 2^64, to the state shifted by the number of bits to find the next
+                                // state
+        };
+
+        UINT8 m_table_log;
+        UINT16 *m_states;       // next states, grouped by symbol
+        SymbolTransform m_transforms[ANS_MAX_SYMBOLS];
+    };
+
+    /**
+     * Defines the tANS decoder matching TansEncoder
+     */
+    class TansDecoder {
+    public:
+        TansDecoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 table_log);
+        ~TansDecoder();
+        TansDecoder(const TansDecoder &other) = delete;
+        TansDecoder &operator=(const TansDecoder &other) = delete;
+
+        /**
+         * Decodes no_symbols symbols from reader, positioned at the end of the bits written by the encoder
+         * @return False if the bits do not decode back to the initial state of the encoder, i.e. they are corrupt
+         */
+        bool decode(BackwardBitReader &reader, UINT8 *symbols, UINT64 no_symbols);
+
+    private:
+        struct DecodeEntry {
+            UINT16 base;        // next state, before adding the bits read
+            UINT8 symbol;
+            UINT8 no_bits;
+        };
+
+        UINT8 m_table_log;
+        DecodeEntry *m_table;
+    };
+
+    /**
+     * Defines a rANS encoder with four interleaved 31-bit states, symbol i being coded by state i % 4
+     */
+    class RansEncoder {
+    public:
+        /**
+         * @param frequencies Frequencies of the no_symbols symbols, summing to 1 << scale_bits
+         * @param scale_bits Between ANS_MIN_TABLE_LOG and ANS_MAX_TABLE_LOG
+         */
+        RansEncoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 scale_bits);
+
+        /**
+         * Encodes the no_symbols symbols, each of non-zero frequency, appending the renormalization words and the
+         * final states to writer
+         */
+        void encode(const UINT8 *symbols, UINT64 no_symbols, BitWriter &writer);
+
+    private:
+        /**
+         * Coding of a symbol without a division, the quotient by the frequency being a multiplication by its
+         * reciprocal and a shift
+         */
+        struct EncodeSymbol {
+            UINT64 upper_bound; // states from which 16 bits are output before coding the symbol
+            UINT32 reciprocal;
+            UINT32 shift;
+            UINT32 bias;        // start of the symbol, the cumulated frequencies of the previous ones
+            UINT32 complement;  // (1 << scale_bits) - frequency
+        };
+
+        UINT8 m_scale_bits;
+        EncodeSymbol m_symbols[ANS_MAX_SYMBOLS];
+    };
+
+    /**
+     * Defines the rANS decoder matching RansEncoder
+     */
+    class RansDecoder {
+    public:
+        RansDecoder(const UINT32 *frequencies, UINT32 no_symbols, UINT8 scale_bits);
+        ~RansDecoder();
+        RansDecoder(const RansDecoder &other) = delete;
+        RansDecoder &operator=(const RansDecoder &other) = delete;
+
+        /**
+         * Decodes no_symbols symbols from reader, positioned at the end of the bits written by the encoder
+         * @return False if the bits do not decode back to the initial states of the encoder, i.e. they are corrupt
+         */
+        bool decode(BackwardBitReader &reader, UINT8 *symbols, UINT64 no_symbols);
+
+    private:
+        struct SlotEntry {
+            UINT32 frequency;
+            UINT16 offset;      // index of the slot among those of its symbol
+            UINT8 symbol;
+        };
+
+        UINT8 m_scale_bits;
+        SlotEntry *m_slots;
+    };
+}
+#endif //EZBITSTREAM_ANS_H
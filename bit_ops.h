@@ -0,0 +1,117 @@
+#ifndef EZBITSTREAM_BIT_OPS_H
+#define EZBITSTREAM_BIT_OPS_H
+#include "ezbitstream.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace ezb {
+    /**
+     * Returns the number of trailing zero bits of word, which must not be 0
+     */
+    inline UINT64 trailing_zeros(UINT64 word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long idx;
+        _BitScanForward64(&idx, word);
+        return idx;
+#else
+        UINT64 count = 0;
+        for (; !(word & 1); word >>= 1) {
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    /**
+     * Returns the number of leading zero bits of word, which must not be 0
+     */
+    inline UINT64 leading_zeros(UINT64 word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_clzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long idx;
+        _BitScanReverse64(&idx, word);
+        return 63 - idx;
+#else
+        UINT64 count = 0;
+        for (; !(word & (1ull << 63)); word <<= 1) {
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    /**
+     * Returns the number of set bits of word
+     */
+    inline UINT64 popcount(UINT64 word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(word);
+#else
+        word = word - ((word >> 1) & 0x5555555555555555ull);
+        word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+        word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return (word * 0x0101010101010101ull) >> 56;
+#endif
+    }
+
+    /**
+     * Returns word with the order of its bytes reversed. Usable in constant expressions, see fixed_bitstream.h
+     */
+    inline constexpr UINT64 byte_swap(UINT64 word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_bswap64(word);
+#else
+        return ((word & 0x00000000000000FFull) << 56) | ((word & 0x000000000000FF00ull) << 40) |
+               ((word & 0x0000000000FF0000ull) << 24) | ((word & 0x00000000FF000000ull) << 8) |
+               ((word >> 8) & 0x00000000FF000000ull) | ((word >> 24) & 0x0000000000FF0000ull) |
+               ((word >> 40) & 0x000000000000FF00ull) | (word >> 56);
+#endif
+    }
+
+    /**
+     * Returns whether a byte of word is less than value, which is at most 128, testing the 8 bytes at once
+     */
+    inline bool has_byte_less_than(UINT64 word, UINT8 value) {
+        return ((word - 0x0101010101010101ull * value) & ~word & 0x8080808080808080ull) != 0;
+    }
+
+    /**
+     * Returns word with the top bit of every 0 byte set and every other bit cleared
+     */
+    inline UINT64 zero_bytes(UINT64 word) {
+        return ~(((word & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | word) & 0x8080808080808080ull;
+    }
+
+    /**
+     * Returns whether a byte of word equals value, testing the 8 bytes at once
+     */
+    inline bool has_byte(UINT64 word, UINT8 value) {
+        return has_byte_less_than(word ^ (0x0101010101010101ull * value), 1);
+    }
+
+    /**
+     * Hints the processor to load the cache line holding address, for writing if write is set. Does nothing on
+     * compilers without a prefetch intrinsic
+     */
+    inline void prefetch(const void *address, bool write = false) {
+#if defined(__GNUC__) || defined(__clang__)
+        if (write) {
+            __builtin_prefetch(address, 1);
+        } else {
+            __builtin_prefetch(address, 0);
+        }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        (void) write;
+        _mm_prefetch((const char *) address, _MM_HINT_T0);
+#else
+        (void) address;
+        (void) write;
+#endif
+    }
+}
+#endif //EZBITSTREAM_BIT_OPS_H
@@ -0,0 +1,51 @@
+#ifndef EZBITSTREAM_BIT_ORDER_H
+#define EZBITSTREAM_BIT_ORDER_H
+#include "ezbitstream.h"
+#include "bit_ops.h"
+
+/**
+ * Bit order policies, given as a template parameter to FixedBitstream, BasicBitWriter and BasicBitReader
+ *
+ *   LsbFirst  bit i of the stream is bit i % 64 of word i / 64, the order of every bitstream of the library
+ *   MsbFirst  bit i of the stream is bit 7 - i % 8 of byte i / 8, the order of JPEG, H.264 and MPEG streams; the first
+ *             bit of a value written or read is its most significant one
+ *
+ * In both orders the buffer holds little endian words. Byte swapping a word of a MsbFirst buffer gives a word holding
+ * its bits in stream order from bit 63 down, so MsbFirst streams are read and written a word at a time, with no
+ * reversal of bits and no pass over the buffer before handing it to a codec.
+ */
+namespace ezb {
+    struct LsbFirst {
+        static const bool MSB_FIRST = false;
+
+        /**
+         * Returns the bit of its word holding bit idx of the stream
+         */
+        static constexpr UINT64 bit_in_word(UINT64 idx) {
+            return idx & 0b111111ull;
+        }
+
+        /**
+         * Converts between a word of the buffer and the word holding its bits in stream order, from bit 0 up
+         */
+        static constexpr UINT64 native(UINT64 word) {
+            return word;
+        }
+    };
+
+    struct MsbFirst {
+        static const bool MSB_FIRST = true;
+
+        static constexpr UINT64 bit_in_word(UINT64 idx) {
+            return (idx & 0b111111ull) ^ 0b111ull;
+        }
+
+        /**
+         * Converts between a word of the buffer and the word holding its bits in stream order, from bit 63 down
+         */
+        static constexpr UINT64 native(UINT64 word) {
+            return byte_swap(word);
+        }
+    };
+}
+#endif //EZBITSTREAM_BIT_ORDER_H
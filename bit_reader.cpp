@@ -0,0 +1,128 @@
+#include "bit_reader.h"
+using namespace ezb;
+
+template<typename Order, typename Stuffing>
+BasicBitReader<Order, Stuffing>::BasicBitReader(const UINT64 *words, UINT64 start, UINT64 end) {
+    init(words, start, end);
+}
+
+template<typename Order, typename Stuffing>
+BasicBitReader<Order, Stuffing>::BasicBitReader(Bitstream64 &stream, UINT64 start, UINT64 end) {
+    init(stream.as<UINT64>().words(), start, end);
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitReader<Order, Stuffing>::init(const UINT64 *words, UINT64 start, UINT64 end) {
+    m_bytes = reinterpret_cast<const UINT8 *>(words);
+    m_full_bytes = end >> 3;
+    m_end = end;
+    m_start = start >> 3;
+    m_consumed = start & 0b111ull;
+    m_window = 0;
+    m_first = m_start;
+    m_escapes = 0;
+    refill();
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitReader<Order, Stuffing>::load_bytes() {
+    m_window = 0;
+    m_escapes = 0;
+    if (Stuffing::ACTIVE) {
+        // most windows holding a byte that may be an escape hold none, and nearly all others hold one, which is
+        // dropped by moving the bytes after it down
+        if (m_start + 9 <= m_full_bytes) {
+            UINT64 escapes = Stuffing::escapes(m_bytes, m_start, m_first);
+            if ((escapes & (escapes - 1)) == 0 && !Stuffing::is_escape(m_bytes, m_start + 8, m_first)) {
+                memcpy(&m_window, m_bytes + m_start, 8);
+                if (escapes != 0) {
+                    UINT64 below = (escapes >> 7) - 1;
+                    m_window = (m_window & below) | ((m_window >> 8) & ~below) |
+                               ((UINT64) m_bytes[m_start + 8] << 56);
+                    m_escapes = (0x111111111ull << ((trailing_zeros(escapes) >> 3) << 2)) & 0xFFFFFFFFFull;
+                }
+                m_window = Order::native(m_window);
+                return;
+            }
+        }
+        // skips an escape following the last byte read, then drops those between the next bytes
+        while (m_start < m_full_bytes && Stuffing::is_escape(m_bytes, m_start, m_first)) {
+            m_start++;
+        }
+        UINT64 no_bytes = 0;
+        UINT64 no_escapes = 0;
+        for (UINT64 idx = m_start; no_bytes < 8 && idx < m_full_bytes; idx++) {
+            if (Stuffing::is_escape(m_bytes, idx, m_first)) {
+                no_escapes++;
+            } else {
+                m_window |= (UINT64) m_bytes[idx] << (no_bytes << 3);
+                m_escapes |= no_escapes << (no_bytes << 2);
+                no_bytes++;
+            }
+        }
+        for (; no_bytes <= 8; no_bytes++) {
+            m_escapes |= no_escapes << (no_bytes << 2);
+        }
+        m_window = Order::native(m_window);
+        return;
+    }
+    if ((m_start << 3) >= m_end) {
+        return;
+    }
+    UINT64 valid = m_end - (m_start << 3);
+    memcpy(&m_window, m_bytes + m_start, (valid + 7) >> 3);
+    if (Order::MSB_FIRST) {
+        m_window = Order::native(m_window) & ~(~0ull >> valid);
+    } else {
+        m_window &= MASK_SHIFT_64_RIGHT[64 - valid];
+    }
+}
+
+template<typename Order, typename Stuffing>
+UINT64 BasicBitReader<Order, Stuffing>::position() {
+    return (m_start << 3) + m_consumed + (escapes_before(m_consumed >> 3) << 3);
+}
+
+template<typename Order, typename Stuffing>
+UINT64 BasicBitReader<Order, Stuffing>::bits_remaining() {
+    return m_end > position() ? m_end - position() : 0;
+}
+
+template<typename Order, typename Stuffing>
+bool BasicBitReader<Order, Stuffing>::overflowed() {
+    return position() > m_end;
+}
+
+template class ezb::BasicBitReader<LsbFirst>;
+template class ezb::BasicBitReader<MsbFirst>;
+template class ezb::BasicBitReader<MsbFirst, JpegStuffing>;
+template class ezb::BasicBitReader<MsbFirst, EmulationPrevention>;
+
+BackwardBitReader::BackwardBitReader(const UINT64 *words, UINT64 end) {
+    init(words, end);
+}
+
+BackwardBitReader::BackwardBitReader(Bitstream64 &stream, UINT64 end) {
+    init(stream.as<UINT64>().words(), end);
+}
+
+void BackwardBitReader::init(const UINT64 *words, UINT64 end) {
+    m_bytes = reinterpret_cast<const UINT8 *>(words);
+    m_end = (end + 7) >> 3;
+    m_consumed = (m_end << 3) - end; // the bits of the last byte past end
+    m_window = 0;
+    if (m_end >= 8) {
+        memcpy(&m_window, m_bytes + m_end - 8, 8);
+    } else if (m_end) { // fewer than 8 bytes, placed at the top of the window
+        memcpy(&m_window, m_bytes, m_end);
+        m_window <<= (8 - m_end) << 3;
+    }
+}
+
+UINT64 BackwardBitReader::bits_remaining() {
+    return (m_end << 3) > m_consumed ? (m_end << 3) - m_consumed : 0;
+}
+
+bool BackwardBitReader::overflowed() {
+    return m_consumed > (m_end << 3);
+}
@@ -0,0 +1,247 @@
+#ifndef EZBITSTREAM_BIT_READER_H
+#define EZBITSTREAM_BIT_READER_H
+#include <string.h>
+#include "ezbitstream.h"
+#include "tables.h"
+#include "bitstream64.h"
+#include "bit_order.h"
+#include "stuffing.h"
+namespace ezb {
+    /**
+     * Defines a sequential reader taking bits from a bitstream in the order they were written, the counterpart of
+     * BitWriter for decoders that read many short fields
+     *
+     * The reader keeps a 64-bit window on the bytes starting at the byte of the current position and takes bits from
+     * its bottom, so a read is a shift and a mask. As for BackwardBitReader, reads do not refill the window: after a
+     * refill, up to 57 bits can be read before the next one, and a read of 0 bits returns 0, so that decoders can read a
+     * computed number of bits without branching. Bits past the end read as 0s and make overflowed true.
+     *
+     * Order sets the bit order of the stream, see bit_order.h. With MsbFirst, the window is byte swapped when loaded
+     * and bits are taken from its top, the first bit read being the most significant of the value.
+     *
+     * Stuffing sets the escaping of the stream, see stuffing.h, and requires MsbFirst. The escape bytes are dropped as
+     * the window is refilled: windows without a byte that can be an escape are loaded as they are, those holding one
+     * escape move the bytes after it down, and only the others are built byte by byte. Positions then count the
+     * escape bytes, so start and end are those of the escaped stream, and the end must be a multiple of 8.
+     */
+    template<typename Order = LsbFirst, typename Stuffing = NoStuffing>
+    class BasicBitReader {
+        static_assert(Order::MSB_FIRST || !Stuffing::ACTIVE, "byte stuffing is defined for MsbFirst streams");
+
+    public:
+        /**
+         * Constructs a reader taking the bits [start, end) of words, refilled
+         * @param words Buffer holding at least the bits [0, end)
+         * @param start Index of the first bit read
+         * @param end Index one past the last bit that can be read
+         */
+        BasicBitReader(const UINT64 *words, UINT64 start, UINT64 end);
+
+        /**
+         * Constructs a reader taking the bits [start, end) of stream, refilled. The stream must not grow while it is
+         * read
+         */
+        BasicBitReader(Bitstream64 &stream, UINT64 start, UINT64 end);
+
+        /**
+         * Returns the next no_bits bits, between 0 and 57 since the last refill, and moves the position past them
+         */
+        inline UINT64 read(UINT8 no_bits);
+
+        /**
+         * Returns the next no_bits bits without moving the position
+         */
+        inline UINT64 peek(UINT8 no_bits);
+
+        /**
+         * Moves the position forward by no_bits bits
+         */
+        inline void skip(UINT8 no_bits);
+
+        /**
+         * Reloads the window so that at least 57 bits can be read
+         */
+        inline void refill();
+
+        /**
+         * Returns the index of the next bit to be read
+         */
+        UINT64 position();
+
+        /**
+         * Returns the number of bits left before the end
+         */
+        UINT64 bits_remaining();
+
+        /**
+         * Returns whether more bits were read than lie between start and end
+         */
+        bool overflowed();
+
+    private:
+        void init(const UINT64 *words, UINT64 start, UINT64 end);
+
+        /**
+         * Loads the window when fewer than 8 whole bytes lie before the end, clearing the bits past it, or when the
+         * bytes may hold escapes, dropping them
+         */
+        void load_bytes();
+
+        /**
+         * Returns the number of escape bytes dropped among the first no_bytes bytes of the window
+         */
+        inline UINT64 escapes_before(UINT64 no_bytes);
+
+        const UINT8 *m_bytes;
+        UINT64 m_full_bytes; // bytes whose bits all lie before the end
+        UINT64 m_end;       // index one past the last bit
+        UINT64 m_start;     // byte index of the window
+        UINT64 m_window;    // bytes [m_start, m_start + 8) as a word in stream order, 0s past the end
+        UINT64 m_consumed;  // bits read from the bottom of the window, or its top for MsbFirst
+        UINT64 m_first;     // byte index of start, escapes are only recognized after it
+        UINT64 m_escapes;   // bits [4k, 4k + 4): number of escape bytes dropped before byte k of the window, k <= 8
+    };
+
+    typedef BasicBitReader<LsbFirst> BitReader;
+    typedef BasicBitReader<MsbFirst> MsbBitReader;
+    typedef BasicBitReader<MsbFirst, JpegStuffing> JpegBitReader;
+    typedef BasicBitReader<MsbFirst, EmulationPrevention> NalBitReader;
+
+    template<typename Order, typename Stuffing>
+    inline UINT64 BasicBitReader<Order, Stuffing>::peek(UINT8 no_bits) {
+        if (Order::MSB_FIRST) {
+            return ((m_window << (m_consumed & 0b111111ull)) >> 1) >> ((63 - no_bits) & 0b111111ull);
+        }
+        return (m_window >> (m_consumed & 0b111111ull)) & MASK_SHIFT_64_RIGHT[64 - no_bits];
+    }
+
+    template<typename Order, typename Stuffing>
+    inline void BasicBitReader<Order, Stuffing>::skip(UINT8 no_bits) {
+        m_consumed += no_bits;
+    }
+
+    template<typename Order, typename Stuffing>
+    inline UINT64 BasicBitReader<Order, Stuffing>::read(UINT8 no_bits) {
+        UINT64 value = peek(no_bits);
+        skip(no_bits);
+        return value;
+    }
+
+    template<typename Order, typename Stuffing>
+    inline UINT64 BasicBitReader<Order, Stuffing>::escapes_before(UINT64 no_bytes) {
+        if (!Stuffing::ACTIVE) {
+            return 0;
+        }
+        return (m_escapes >> (no_bytes << 2)) & 0b1111ull;
+    }
+
+    template<typename Order, typename Stuffing>
+    inline void BasicBitReader<Order, Stuffing>::refill() {
+        m_start += m_consumed >> 3;
+        if (Stuffing::ACTIVE && m_escapes != 0) {
+            m_start += escapes_before(m_consumed >> 3);
+        }
+        m_consumed &= 0b111ull;
+        if (m_start + 8 <= m_full_bytes) {
+            memcpy(&m_window, m_bytes + m_start, 8);
+            if (!Stuffing::may_hold_escape(m_window)) {
+                m_window = Order::native(m_window);
+                m_escapes = 0;
+                return;
+            }
+        }
+        load_bytes();
+    }
+
+    /**
+     * Defines a reader taking bits from the end of a bitstream towards its start, as entropy coders of the ANS family
+     * need: the encoder writes forward with a BitWriter, and every read returns the bits of the latest write not read
+     * yet, in the order they were written (bit 0 of the value is the lowest index of the stream)
+     *
+     * The reader keeps a 64-bit window on the bytes ending at the current position and takes bits from its top, so a
+     * read is two shifts. Reads do not refill the window: after a refill, up to 57 bits can be read before the next one,
+     * which lets decoders refill once for several symbols. The buffer is read as little endian bytes, see word_view.h.
+     * Reading more bits than lie between index 0 and the end makes overflowed true, the values read are then
+     * unspecified.
+     */
+    class BackwardBitReader {
+    public:
+        /**
+         * Constructs a reader taking bits backward from the bit end of words, refilled
+         * @param words Buffer holding at least the bits [0, end)
+         * @param end Index one past the last bit written, e.g. the pointer of the stream after the writer flushed
+         */
+        BackwardBitReader(const UINT64 *words, UINT64 end);
+
+        /**
+         * Constructs a reader taking bits backward from the bit end of stream, refilled. The stream must not grow while
+         * it is read
+         */
+        BackwardBitReader(Bitstream64 &stream, UINT64 end);
+
+        /**
+         * Returns the no_bits bits before the position, between 0 and 57 since the last refill, and moves the position
+         * back by no_bits
+         */
+        inline UINT64 read(UINT8 no_bits);
+
+        /**
+         * Returns the no_bits bits before the position without moving it
+         */
+        inline UINT64 peek(UINT8 no_bits);
+
+        /**
+         * Moves the position back by no_bits bits
+         */
+        inline void skip(UINT8 no_bits);
+
+        /**
+         * Reloads the window so that at least 57 bits can be read, or all the bits left if fewer
+         */
+        inline void refill();
+
+        /**
+         * Returns the number of bits left before the position
+         */
+        UINT64 bits_remaining();
+
+        /**
+         * Returns whether more bits were read than the stream holds before end
+         */
+        bool overflowed();
+
+    private:
+        void init(const UINT64 *words, UINT64 end);
+
+        const UINT8 *m_bytes;
+        UINT64 m_end;       // byte index one past the window, the window holds the 8 bytes before it
+        UINT64 m_window;    // bytes [m_end - 8, m_end) as a little endian word, 0s for bytes before the buffer
+        UINT64 m_consumed;  // bits read from the top of the window
+    };
+
+    inline UINT64 BackwardBitReader::peek(UINT8 no_bits) {
+        return ((m_window << (m_consumed & 0b111111ull)) >> 1) >> ((63 - no_bits) & 0b111111ull);
+    }
+
+    inline void BackwardBitReader::skip(UINT8 no_bits) {
+        m_consumed += no_bits;
+    }
+
+    inline UINT64 BackwardBitReader::read(UINT8 no_bits) {
+        UINT64 value = peek(no_bits);
+        skip(no_bits);
+        return value;
+    }
+
+    inline void BackwardBitReader::refill() {
+        if (m_end < 8) { // the window already covers the start of the buffer
+            return;
+        }
+        UINT64 back = m_consumed >> 3;
+        back = back < m_end - 8 ? back : m_end - 8;
+        m_end -= back;
+        m_consumed -= back << 3;
+        memcpy(&m_window, m_bytes + m_end - 8, 8);
+    }
+}
+#endif //EZBITSTREAM_BIT_READER_H
@@ -0,0 +1,136 @@
+#include "bit_writer.h"
+#include <string.h>
+using namespace ezb;
+
+template<typename Order, typename Stuffing>
+BasicBitWriter<Order, Stuffing>::BasicBitWriter(Bitstream64 &stream, bool checksum) : m_stream(stream) {
+    m_word = 0;
+    m_count = 0;
+    m_stored = 0;
+    m_written = 0;
+    m_checksum = checksum;
+    m_crc = 0;
+    m_escape_state = 0;
+}
+
+template<typename Order, typename Stuffing>
+BasicBitWriter<Order, Stuffing>::~BasicBitWriter() {
+    flush();
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitWriter<Order, Stuffing>::write(UINT64 data, UINT8 no_bits_to_write) {
+    data &= MASK_SHIFT_64_RIGHT[64 - no_bits_to_write];
+    m_written += no_bits_to_write;
+    if (Order::MSB_FIRST) {
+        if (m_count + no_bits_to_write < 64) {
+            m_word |= (data << 1) << (63 - m_count - no_bits_to_write);
+            m_count += no_bits_to_write;
+            return;
+        }
+        // the accumulator fills up with the upper bits of data, store it and keep the lower ones at its top
+        UINT64 left = m_count + no_bits_to_write - 64;
+        store(m_word | (data >> left));
+        m_word = left > 0 ? data << (64 - left) : 0;
+        m_count = left;
+        return;
+    }
+    if (m_count + no_bits_to_write < 64) {
+        m_word |= data << m_count;
+        m_count += no_bits_to_write;
+        return;
+    }
+    // the accumulator fills up, store it and keep the bits of data that did not fit
+    UINT64 fitting = 64 - m_count;
+    store(m_word | (data << m_count));
+    m_word = fitting < 64 ? data >> fitting : 0;
+    m_count = no_bits_to_write - fitting;
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitWriter<Order, Stuffing>::flush() {
+    if (Order::MSB_FIRST) {
+        // the whole bytes are stored for good, the partial one is rewritten by the next flush or store
+        UINT64 bytes = Order::native(m_word);
+        UINT64 no_whole = m_count >> 3;
+        if (no_whole > 0) {
+            if (Stuffing::ACTIVE) {
+                stuff(bytes, no_whole);
+            } else {
+                m_stream.write_word(bytes, (UINT8) (no_whole << 3));
+            }
+            if (m_checksum) {
+                m_crc = ezb::crc32c(&bytes, no_whole, m_crc);
+            }
+            m_word <<= no_whole << 3;
+            m_count -= no_whole << 3;
+        }
+        if (m_count > 0) {
+            m_stream.write_word(m_stream.pointer(), Order::native(m_word), (UINT8) 8);
+        }
+        return;
+    }
+    if (m_count > m_stored) {
+        UINT8 no_bits = m_count - m_stored;
+        m_stream.write_word(m_word >> m_stored, no_bits);
+        m_stored = m_count;
+    }
+}
+
+template<typename Order, typename Stuffing>
+UINT64 BasicBitWriter<Order, Stuffing>::bits_written() {
+    return m_written;
+}
+
+template<typename Order, typename Stuffing>
+UINT32 BasicBitWriter<Order, Stuffing>::crc32c() {
+    UINT64 bytes = Order::native(m_word);
+    return ezb::crc32c(&bytes, (m_count + 7) >> 3, m_crc);
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitWriter<Order, Stuffing>::store(UINT64 word) {
+    word = Order::native(word);
+    if (Stuffing::ACTIVE) {
+        if (Stuffing::may_escape(word)) {
+            stuff(word, 8);
+        } else {
+            m_stream.write_word(word, (UINT8) 64);
+            m_escape_state = 0; // the last byte did not need an escape, nor can it start one
+        }
+        if (m_checksum) {
+            m_crc = ezb::crc32c(&word, 8, m_crc);
+        }
+        return;
+    }
+    UINT8 no_bits = 64 - m_stored;
+    m_stream.write_word(word >> m_stored, no_bits);
+    m_stored = 0;
+    if (m_checksum) {
+        m_crc = ezb::crc32c(&word, 8, m_crc);
+    }
+}
+
+template<typename Order, typename Stuffing>
+void BasicBitWriter<Order, Stuffing>::stuff(UINT64 bytes, UINT64 no_bytes) {
+    UINT8 out[16];
+    UINT64 no_out = 0;
+    for (UINT64 i = 0; i < no_bytes; i++) {
+        no_out += Stuffing::stuff((UINT8) (bytes >> (i << 3)), m_escape_state, out + no_out);
+    }
+    UINT64 word;
+    if (no_out > 8) {
+        memcpy(&word, out, 8);
+        m_stream.write_word(word, (UINT8) 64);
+        no_out -= 8;
+        memmove(out, out + 8, no_out);
+    }
+    word = 0;
+    memcpy(&word, out, no_out);
+    m_stream.write_word(word, (UINT8) (no_out << 3));
+}
+
+template class ezb::BasicBitWriter<LsbFirst>;
+template class ezb::BasicBitWriter<MsbFirst>;
+template class ezb::BasicBitWriter<MsbFirst, JpegStuffing>;
+template class ezb::BasicBitWriter<MsbFirst, EmulationPrevention>;
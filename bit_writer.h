@@ -0,0 +1,89 @@
+#ifndef EZBITSTREAM_BIT_WRITER_H
+#define EZBITSTREAM_BIT_WRITER_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "bitstream64.h"
+#include "checksum.h"
+#include "bit_order.h"
+#include "stuffing.h"
+namespace ezb {
+    /**
+     * Defines a sequential writer appending bits to a Bitstream64 at its pointer
+     *
+     * Bits are gathered in a 64-bit accumulator and only whole words are stored to the stream, so that small writes
+     * cost a shift and an or. The writer can keep the CRC-32C of everything written up to date as the words are stored,
+     * while they are still in registers. Pending bits reach the stream on flush, and on destruction.
+     *
+     * Order sets the bit order of the stream, see bit_order.h. With MsbFirst, the accumulator is left aligned: writes
+     * fill it from its top, the most significant bit of a value first, and full accumulators are byte swapped before
+     * being stored. The pointer of the stream must then be a multiple of 8 at construction, and flush stores the
+     * pending whole bytes and the last partial one padded with 0s, which is rewritten as more bits are written.
+     *
+     * Stuffing sets the escaping of the stored bytes, see stuffing.h, and requires MsbFirst. Words without a byte
+     * that can need an escape are stored as they are; the others are stored byte by byte with their escapes. Bytes are
+     * stuffed once whole, so the last partial byte has to be completed before the stream is handed over.
+     */
+    template<typename Order = LsbFirst, typename Stuffing = NoStuffing>
+    class BasicBitWriter {
+        static_assert(Order::MSB_FIRST || !Stuffing::ACTIVE, "byte stuffing is defined for MsbFirst streams");
+
+    public:
+        /**
+         * Constructs a writer appending to stream from its pointer
+         * @param stream Destination stream, its pointer advances as words are stored
+         * @param checksum If true, the CRC-32C of the bits written is maintained, see crc32c
+         */
+        BasicBitWriter(Bitstream64 &stream, bool checksum = false);
+        ~BasicBitWriter();
+
+        /**
+         * Appends the lower no_bits_to_write bits of data
+         * @param data Bits to be written
+         * @param no_bits_to_write Number of bits, can not be more than 64
+         */
+        void write(UINT64 data, UINT8 no_bits_to_write);
+
+        /**
+         * Stores the pending bits to the stream. Writing can continue afterwards
+         */
+        void flush();
+
+        /**
+         * Returns the number of bits written through the writer
+         */
+        UINT64 bits_written();
+
+        /**
+         * Returns the CRC-32C of the bits written so far taken as bytes, the last byte padded with 0s. Equal to
+         * stream.crc32c(start, bits_written()) for the pointer start of the stream at construction, and taken before
+         * the escapes are inserted with a stuffing policy. The writer must have been constructed with checksum set
+         */
+        UINT32 crc32c();
+
+    private:
+        /**
+         * Stores a full accumulator word, minus the bits a flush already stored
+         */
+        void store(UINT64 word);
+
+        /**
+         * Stores the no_bytes lower bytes of bytes, in memory order, with their escapes
+         */
+        void stuff(UINT64 bytes, UINT64 no_bytes);
+
+        Bitstream64 &m_stream;
+        UINT64 m_word;      // pending bits, in the lower m_count bits, or the upper ones for MsbFirst
+        UINT64 m_count;
+        UINT64 m_stored;    // number of the pending bits already stored by flush, always 0 for MsbFirst
+        UINT64 m_written;
+        bool m_checksum;
+        UINT32 m_crc;       // CRC of the words stored so far
+        UINT64 m_escape_state; // state of the stuffing policy
+    };
+
+    typedef BasicBitWriter<LsbFirst> BitWriter;
+    typedef BasicBitWriter<MsbFirst> MsbBitWriter;
+    typedef BasicBitWriter<MsbFirst, JpegStuffing> JpegBitWriter;
+    typedef BasicBitWriter<MsbFirst, EmulationPrevention> NalBitWriter;
+}
+#endif //EZBITSTREAM_BIT_WRITER_H
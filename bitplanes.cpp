@@ -0,0 +1,119 @@
+#include "bitplanes.h"
+using namespace ezb;
+
+namespace {
+    /**
+     * Swaps, in every pair of width x width blocks along the diagonal, the upper right and the lower left blocks
+     */
+    inline void transpose_stage(UINT64 *block, UINT64 width, UINT64 mask) {
+        for (UINT64 base = 0; base < 64; base += width << 1) {
+            for (UINT64 row = base; row < base + width; row++) { // contiguous rows, vectorized by the compiler
+                UINT64 swap = ((block[row] >> width) ^ block[row + width]) & mask;
+                block[row] ^= swap << width;
+                block[row + width] ^= swap;
+            }
+        }
+    }
+
+    /**
+     * Transposes the 8x8 bit matrix held in a word, byte i holding row i
+     */
+    inline UINT64 transpose8(UINT64 x) {
+        UINT64 swap = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+        x ^= swap ^ (swap << 7);
+        swap = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+        x ^= swap ^ (swap << 14);
+        swap = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+        return x ^ swap ^ (swap << 28);
+    }
+
+    /**
+     * Transposes 64 values of at most 8 bits into their width bit-planes of 64 bits with eight 8x8 transposes
+     */
+    inline void to_planes8(const UINT64 *values, UINT64 width, UINT64 *planes) {
+        for (UINT64 j = 0; j < width; j++) {
+            planes[j] = 0;
+        }
+        for (UINT64 group = 0; group < 8; group++) {
+            UINT64 rows = 0;
+            for (UINT64 k = 0; k < 8; k++) {
+                rows |= values[(group << 3) + k] << (k << 3);
+            }
+            rows = transpose8(rows);
+            for (UINT64 j = 0; j < width; j++) {
+                planes[j] |= ((rows >> (j << 3)) & 0xFFull) << (group << 3);
+            }
+        }
+    }
+
+    /**
+     * Inverse of to_planes8
+     */
+    inline void from_planes8(const UINT64 *planes, UINT64 width, UINT64 *values) {
+        for (UINT64 group = 0; group < 8; group++) {
+            UINT64 columns = 0;
+            for (UINT64 j = 0; j < width; j++) {
+                columns |= ((planes[j] >> (group << 3)) & 0xFFull) << (j << 3);
+            }
+            columns = transpose8(columns);
+            for (UINT64 k = 0; k < 8; k++) {
+                values[(group << 3) + k] = (columns >> (k << 3)) & 0xFFull;
+            }
+        }
+    }
+}
+
+void ezb::transpose64(UINT64 *block) {
+    // swap the off-diagonal 32x32 blocks, then the 16x16 blocks within each, down to single bits. The stages are
+    // spelled out so that each is unrolled with constant shifts
+    transpose_stage(block, 32, 0x00000000FFFFFFFFull);
+    transpose_stage(block, 16, 0x0000FFFF0000FFFFull);
+    transpose_stage(block, 8, 0x00FF00FF00FF00FFull);
+    transpose_stage(block, 4, 0x0F0F0F0F0F0F0F0Full);
+    transpose_stage(block, 2, 0x3333333333333333ull);
+    transpose_stage(block, 1, 0x5555555555555555ull);
+}
+
+void ezb::transpose_to_bitplanes(Bitstream64 &source, UINT64 no_values, UINT8 width, Bitstream64 *planes) {
+    UINT64 block[64];
+    UINT64 narrow[64];
+    for (UINT64 done = 0; done < no_values; done += 64) {
+        UINT64 no_rows = no_values - done < 64 ? no_values - done : 64;
+        source.read_packed(block, no_rows, width);
+        for (UINT64 i = no_rows; i < 64; i++) {
+            block[i] = 0;
+        }
+        UINT64 *columns = block;
+        if (width <= 8) { // narrow values, a few 8x8 transposes suffice
+            to_planes8(block, width, narrow);
+            columns = narrow;
+        } else {
+            transpose64(block);
+        }
+        UINT8 no_bits = (UINT8) no_rows;
+        for (UINT64 j = 0; j < width; j++) {
+            planes[j].write_word(columns[j], no_bits);
+        }
+    }
+}
+
+void ezb::from_bitplanes(Bitstream64 *planes, UINT64 no_values, UINT8 width, Bitstream64 &destination) {
+    UINT64 block[64];
+    UINT64 narrow[64];
+    for (UINT64 done = 0; done < no_values; done += 64) {
+        UINT64 no_rows = no_values - done < 64 ? no_values - done : 64;
+        for (UINT64 j = 0; j < width; j++) {
+            planes[j].read_packed(&block[j], 1, (UINT8) no_rows);
+        }
+        if (width <= 8) {
+            from_planes8(block, width, narrow);
+            destination.write_packed(narrow, no_rows, width);
+            continue;
+        }
+        for (UINT64 j = width; j < 64; j++) {
+            block[j] = 0;
+        }
+        transpose64(block);
+        destination.write_packed(block, no_rows, width);
+    }
+}
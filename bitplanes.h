@@ -0,0 +1,39 @@
+#ifndef EZBITSTREAM_BITPLANES_H
+#define EZBITSTREAM_BITPLANES_H
+#include "ezbitstream.h"
+#include "bitstream64.h"
+
+/**
+ * Conversion between a row layout, values of w bits stored back to back, and a column layout of w bit-planes, plane j
+ * holding bit j of every value. Values are processed 64 at a time as a 64x64 bit matrix which is transposed in
+ * registers, instead of moving bits one by one.
+ */
+namespace ezb {
+    /**
+     * Transposes the 64x64 bit matrix in block in place: bit j of block[i] is swapped with bit i of block[j]
+     * @param block 64 words, word i holding row i
+     */
+    void transpose64(UINT64 *block);
+
+    /**
+     * Reads no_values values of width bits from the pointer of source and appends bit j of each value to planes[j],
+     * at its pointer, for every j < width. Advances the pointers of source and of the planes
+     * @param source Stream holding the values back to back
+     * @param no_values Number of values
+     * @param width Number of bits per value, can not be more than 64
+     * @param planes Array of width streams receiving the bit-planes
+     */
+    void transpose_to_bitplanes(Bitstream64 &source, UINT64 no_values, UINT8 width, Bitstream64 *planes);
+
+    /**
+     * Inverse of transpose_to_bitplanes: reads no_values bits from the pointer of each of the width planes and writes
+     * the values they form back to back at the pointer of destination. Advances the pointers of the planes and of
+     * destination
+     * @param planes Array of width streams holding the bit-planes
+     * @param no_values Number of values
+     * @param width Number of bits per value, can not be more than 64
+     * @param destination Stream receiving the values
+     */
+    void from_bitplanes(Bitstream64 *planes, UINT64 no_values, UINT8 width, Bitstream64 &destination);
+}
+#endif //EZBITSTREAM_BITPLANES_H
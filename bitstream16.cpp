@@ -1,43 +1,88 @@
-#include "Bitstream16.h"
+#include "bitstream16.h"
+#include "bitstream8.h"
+#include "bitstream32.h"
+#include "bitstream64.h"
 using namespace ezb;
 
 Bitstream16::Bitstream16(UINT64 no_bits) {
     m_pointer = 0;
+    m_size = 0;
+    m_free_count = 0;
     m_capacity = (no_bits >> 4) == 0 ? 1 : (no_bits >> 4);
-    m_two_bytes = new UINT16[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
-        m_two_bytes[i] = 0;
+    if (m_capacity <= INLINE_WORDS) { // small streams start in the inline buffer
+        m_capacity = INLINE_WORDS;
+        m_two_bytes = m_inline;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_two_bytes[i] = 0;
+        }
+    } else {
+        m_two_bytes = allocate_words<UINT16>(m_capacity);
     }
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT16)));
 }
 
 Bitstream16::~Bitstream16() {
-    delete m_two_bytes;
+    if (m_two_bytes != m_inline) {
+        release_words(m_two_bytes, m_capacity);
+    }
+    for(UINT64 i = 0; i < m_free_count; i++) {
+        release_words(m_free_buffers[i], m_free_sizes[i]);
+    }
 }
 
 Bitstream16::Bitstream16(const Bitstream16 &other) {
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_two_bytes = new UINT16[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_free_count = 0;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_two_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_two_bytes[i] = 0;
+        }
+    } else {
+        m_two_bytes = allocate_words<UINT16>(m_capacity);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_two_bytes[i] = other.m_two_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT16)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT16)));
 }
 
 Bitstream16 Bitstream16::operator=(const Bitstream16 &other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (m_two_bytes != m_inline) {
+        release_words(m_two_bytes, m_capacity);
+    }
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_two_bytes = new UINT16[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_two_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_two_bytes[i] = 0;
+        }
+    } else {
+        m_two_bytes = allocate_words<UINT16>(m_capacity);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_two_bytes[i] = other.m_two_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT16)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT16)));
     return *this;
 }
 
 void Bitstream16::set_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_two_bytes[(idx >> 4)] |= 0b1ull << (idx & 0b1111ull);
 }
 
 void Bitstream16::clear_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_two_bytes[(idx >> 4)] &= ~(0b1ull << ((idx & 0b1111ull)));
 }
 
@@ -48,7 +93,7 @@ bool Bitstream16::get_bit(UINT64 idx) {
 UINT16 Bitstream16::read_word(UINT64 start, UINT8 no_bits_to_read) {
     UINT64 word_idx = start >> 4;
     UINT64 bit_start_offset = start & 0b1111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - start + 1) & 0b1111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_read - 1) & 0b1111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_two_bytes[word_idx] & MASK_SHIFT_16_RIGHT[16-no_bits_to_read];
     }
@@ -56,14 +101,15 @@ UINT16 Bitstream16::read_word(UINT64 start, UINT8 no_bits_to_read) {
         return (m_two_bytes[word_idx] & (MASK_SHIFT_16_LEFT[bit_start_offset] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_two_bytes[word_idx] & MASK_SHIFT_16_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_two_bytes[word_idx + 1] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset]) << (16-bit_end_offset));
+            ((m_two_bytes[word_idx + 1] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset]) << (16-bit_start_offset));
 }
 
 UINT16 Bitstream16::read_word(UINT8 no_bits_to_read) {
     UINT64 word_idx = m_pointer >> 4;
     UINT64 bit_start_offset = m_pointer & 0b1111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - m_pointer + 1) & 0b1111ull;
+    UINT64 bit_end_offset = (m_pointer + no_bits_to_read - 1) & 0b1111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_two_bytes[word_idx] & MASK_SHIFT_16_RIGHT[16-no_bits_to_read];
     }
@@ -71,17 +117,20 @@ UINT16 Bitstream16::read_word(UINT8 no_bits_to_read) {
         return (m_two_bytes[word_idx] & (MASK_SHIFT_16_LEFT[bit_start_offset] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_two_bytes[word_idx] & MASK_SHIFT_16_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_two_bytes[word_idx + 1] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset]) << (16-bit_end_offset));
+            ((m_two_bytes[word_idx + 1] & MASK_SHIFT_16_RIGHT[15 - bit_end_offset]) << (16-bit_start_offset));
 }
 
 void Bitstream16::write_word(UINT64 start, UINT16 data, UINT8 no_bits_to_write) {
     while(start + no_bits_to_write > (m_capacity << 4)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 word_idx = start >> 4;
     UINT64 bit_start_offset = start & 0b1111ull;
     UINT64 bit_end_offset = (start + no_bits_to_write - 1) & 0b1111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_two_bytes[word_idx] &= MASK_SHIFT_16_LEFT[no_bits_to_write];
@@ -96,6 +145,7 @@ void Bitstream16::write_word(UINT64 start, UINT16 data, UINT8 no_bits_to_write)
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_two_bytes[word_idx] &= ~MASK_SHIFT_16_LEFT[bit_start_offset];
     m_two_bytes[word_idx++] |= (data << bit_start_offset);
     m_two_bytes[word_idx] &= MASK_SHIFT_16_LEFT[++bit_end_offset];
@@ -106,9 +156,11 @@ void Bitstream16::write_word(UINT16 data, UINT8 no_bits_to_write) {
     while(m_pointer + no_bits_to_write > (m_capacity << 4)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 word_idx = m_pointer >> 4;
     UINT64 bit_start_offset = m_pointer & 0b1111ull;
     UINT64 bit_end_offset = (m_pointer + no_bits_to_write - 1) & 0b1111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_two_bytes[word_idx] &= MASK_SHIFT_16_LEFT[no_bits_to_write];
@@ -124,6 +176,7 @@ void Bitstream16::write_word(UINT16 data, UINT8 no_bits_to_write) {
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_two_bytes[word_idx] &= ~MASK_SHIFT_16_LEFT[bit_start_offset];
     m_two_bytes[word_idx++] |= (data << bit_start_offset);
     m_two_bytes[word_idx] &= MASK_SHIFT_16_LEFT[++bit_end_offset];
@@ -135,8 +188,11 @@ void Bitstream16::write_buffer(UINT64 start, UINT16* data, UINT64 data_size, UIN
     while(start + no_bits_to_write > (m_capacity << 4)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 bit_offset = start & 0b1111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 4));
         // write the first no_bits_to_write / 16 words to the bitstream
         UINT64 cur_word = start >> 4;
         UINT64 i;
@@ -164,6 +220,7 @@ void Bitstream16::write_buffer(UINT64 start, UINT16* data, UINT64 data_size, UIN
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = start >> 4;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 4); i++) {
@@ -182,8 +239,11 @@ void Bitstream16::write_buffer(UINT16* data, UINT64 data_size, UINT64 no_bits_to
     while(m_pointer + no_bits_to_write > (m_capacity << 4)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 bit_offset = m_pointer & 0b1111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 4));
         // write the first no_bits_to_write / 16 words to the bitstream
         UINT64 cur_word = m_pointer >> 4;
         UINT64 i;
@@ -211,6 +271,7 @@ void Bitstream16::write_buffer(UINT16* data, UINT64 data_size, UINT64 no_bits_to
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = m_pointer >> 4;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 4); i++) {
@@ -227,199 +288,76 @@ void Bitstream16::write_buffer(UINT16* data, UINT64 data_size, UINT64 no_bits_to
 }
 
 void Bitstream16::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 4)) { // reading from unallocated memory
-        return;
-    }
-    while(start_destination + no_bits_to_write > (m_capacity << 4)) {
-        double_capacity();
-    }
-    // try to word align the source by writing 16 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 16 - (start_source & 0b1111ull) ? no_bits_to_write : 16 - no_bits_to_write;
-    UINT16 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(start_destination, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    start_destination += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
-
-    UINT64 bit_offset_dst = start_destination & 0b1111ull;
-    //UINT64 bit_offset_src = start_source & 0b1111ull; // at this point bit_offset_src is zero
-
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 4;
-        UINT64 cur_word_src = start_source >> 4;
-        for (i = 0; i < (no_bits_to_write >> 4); i++) { // just copy the words until boundary
-            m_two_bytes[cur_word_dst++] = source.m_two_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bits_left];
-            m_two_bytes[cur_word_dst] |= source.m_two_bytes[cur_word_src] & MASK_SHIFT_16_RIGHT[16 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 4;
-        UINT64 cur_word_src = start_source >> 4;
-        for(i = 0; i < (no_bits_to_write >> 4); i++) { // writes will always span two words
-            m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-            m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src] << bit_offset_dst);
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bit_offset_dst - 1];
-            m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src++] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b1111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT16 mask = MASK_SHIFT_16_LEFT[bit_offset_dst] & MASK_SHIFT_16_RIGHT[15-end_offset];
-                m_two_bytes[cur_word_dst] &= ~mask;
-                m_two_bytes[cur_word_dst] |= mask & (source.m_two_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-                m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src]  << bit_offset_dst);
-                m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[++end_offset];
-                m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[end_offset];
-            }
-        }
-    }
+    // the same copy as for the other widths, source may be this stream
+    write_stream<Bitstream16>(start_destination, start_source, no_bits_to_write, source);
 }
 
 void Bitstream16::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 4)) { // reading from unallocated memory
-        return;
-    }
-    while(m_pointer + no_bits_to_write > (m_capacity << 4)) {
-        double_capacity();
-    }
-    // try to word align the source by writing 16 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 16 - (start_source & 0b1111ull) ? no_bits_to_write : 16 - no_bits_to_write;
-    UINT16 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    m_pointer += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
+    write_stream<Bitstream16>(start_source, no_bits_to_write, source);
+}
 
-    UINT64 bit_offset_dst = m_pointer & 0b1111ull;
-    //UINT64 bit_offset_src = start_source & 0b1111ull; // at this point bit_offset_src is zero
+void Bitstream16::write_stream(UINT64 no_bits_to_write, Bitstream16 &source) {
+    write_stream<Bitstream16>(no_bits_to_write, source);
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 4;
-        UINT64 cur_word_src = start_source >> 4;
-        for (i = 0; i < (no_bits_to_write >> 4); i++) { // just copy the words until boundary
-            m_two_bytes[cur_word_dst++] = source.m_two_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bits_left];
-            m_two_bytes[cur_word_dst] |= source.m_two_bytes[cur_word_src] & MASK_SHIFT_16_RIGHT[16 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 4;
-        UINT64 cur_word_src = start_source >> 4;
-        for(i = 0; i < (no_bits_to_write >> 4); i++) { // writes will always span two words
-            m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-            m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src] << bit_offset_dst);
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bit_offset_dst - 1];
-            m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src++] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b1111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT16 mask = MASK_SHIFT_16_LEFT[bit_offset_dst] & MASK_SHIFT_16_RIGHT[15-end_offset];
-                m_two_bytes[cur_word_dst] &= ~mask;
-                m_two_bytes[cur_word_dst] |= mask & (source.m_two_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-                m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src]  << bit_offset_dst);
-                m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[++end_offset];
-                m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[end_offset];
-            }
+void Bitstream16::flush(UINT16* &buffer, UINT64 &size, UINT64 new_capacity) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    hand_out_buffer(buffer, size);
+    if (new_capacity <= INLINE_WORDS) {
+        m_two_bytes = m_inline;
+        m_capacity = INLINE_WORDS;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_two_bytes[i] = 0;
         }
+    } else {
+        m_two_bytes = acquire_buffer(new_capacity, m_capacity);
     }
-    m_pointer += no_bits_to_write;
+    m_pointer = 0;
+    m_size = 0;
 }
 
-void Bitstream16::write_stream(UINT64 no_bits_to_write, Bitstream16 &source) {
-    if(source.m_pointer + no_bits_to_write > (source.m_capacity << 4)) { // reading from unallocated memory
+void Bitstream16::flush(UINT16* &buffer, UINT64 &size, UINT16* replacement, UINT64 replacement_size) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    UINT64 i = 0;
+    if (m_two_bytes == m_inline && replacement_size >= m_capacity) {
+        // keep the inline buffer and hand its contents out in the replacement instead of allocating a copy
+        buffer = replacement;
+        size = replacement_size;
+        for(; i < m_capacity; i++) {
+            buffer[i] = m_two_bytes[i];
+            m_two_bytes[i] = 0;
+        }
+        for(; i < size; i++) {
+            buffer[i] = 0;
+        }
+        m_pointer = 0;
+        m_size = 0;
         return;
     }
-    while(m_pointer + no_bits_to_write > (m_capacity << 4)) {
-        double_capacity();
+    hand_out_buffer(buffer, size);
+    m_two_bytes = replacement;
+    m_capacity = replacement_size;
+    for(; i < m_capacity; i++) {
+        m_two_bytes[i] = 0;
     }
-    // try to word align the source by writing 16 - source.m_pointer bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 16 - (source.m_pointer & 0b1111ull) ? no_bits_to_write : 16 - no_bits_to_write;
-    UINT16 initial_source_data = source.read_word(source.m_pointer, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    m_pointer += initial_bits_to_write;
-    source.m_pointer += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
-
-    UINT64 bit_offset_dst = m_pointer & 0b1111ull;
-    //UINT64 bit_offset_src = start_source & 0b1111ull; // at this point bit_offset_src is zero
+    m_pointer = 0;
+    m_size = 0;
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 4;
-        UINT64 cur_word_src = source.m_pointer >> 4;
-        for (i = 0; i < (no_bits_to_write >> 4); i++) { // just copy the words until boundary
-            m_two_bytes[cur_word_dst++] = source.m_two_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bits_left];
-            m_two_bytes[cur_word_dst] |= source.m_two_bytes[cur_word_src] & MASK_SHIFT_16_RIGHT[16 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 4;
-        UINT64 cur_word_src = source.m_pointer >> 4;
-        for(i = 0; i < (no_bits_to_write >> 4); i++) { // writes will always span two words
-            m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-            m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src] << bit_offset_dst);
-            m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[bit_offset_dst - 1];
-            m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src++] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b1111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b1111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT16 mask = MASK_SHIFT_16_LEFT[bit_offset_dst] & MASK_SHIFT_16_RIGHT[15-end_offset];
-                m_two_bytes[cur_word_dst] &= ~mask;
-                m_two_bytes[cur_word_dst] |= mask & (source.m_two_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_two_bytes[cur_word_dst] &= ~MASK_SHIFT_16_LEFT[bit_offset_dst];
-                m_two_bytes[cur_word_dst++] |= (source.m_two_bytes[cur_word_src]  << bit_offset_dst);
-                m_two_bytes[cur_word_dst] &= MASK_SHIFT_16_LEFT[++end_offset];
-                m_two_bytes[cur_word_dst] |= (source.m_two_bytes[cur_word_src] >> (16 - bit_offset_dst)) & ~MASK_SHIFT_16_LEFT[end_offset];
-            }
-        }
+void Bitstream16::return_buffer(UINT16* buffer, UINT64 size) {
+    if (m_free_count == EZB_FREE_LIST_SLOTS) { // free list is full, release the buffer
+        release_words(buffer, size);
+        return;
     }
-    m_pointer += no_bits_to_write;
-    source.m_pointer += no_bits_to_write;
+    m_free_buffers[m_free_count] = buffer;
+    m_free_sizes[m_free_count] = size;
+    m_free_count++;
 }
 
-void Bitstream16::flush(UINT16* &buffer, UINT64 &size, UINT64 new_capacity) {
-    buffer = m_two_bytes;
-    size = m_capacity;
-    m_two_bytes = new UINT16[new_capacity];
-    m_capacity = new_capacity;
+void Bitstream16::flush_trimmed(UINT16* &buffer, UINT64 &size, UINT64 &words_used, UINT64 &bits_used, UINT64 new_capacity) {
+    bits_used = m_size;
+    words_used = (m_size + 15) >> 4;
+    flush(buffer, size, new_capacity);
 }
 
 void Bitstream16::increment_pointer(UINT64 increment) {
@@ -442,16 +380,147 @@ UINT64 Bitstream16::capacity() {
     return m_capacity;
 }
 
+UINT64 Bitstream16::size_bits() {
+    return m_size;
+}
+
+BitstreamStats Bitstream16::stats() {
+#ifdef EZB_ENABLE_STATS
+    return m_stats;
+#else
+    return BitstreamStats();
+#endif
+}
+
 void Bitstream16::double_capacity() {
-    UINT16* old_buffer = m_two_bytes;
-    m_two_bytes = new UINT16[m_capacity << 1];
-    UINT64 i = 0;
-    for(; i < m_capacity; i++) {
-        m_two_bytes[i] = old_buffer[i];
-    }
-    for(; i < (m_capacity << 1); i++) {
-        m_two_bytes[i] = 0;
+    if (m_two_bytes == m_inline) {
+        m_two_bytes = allocate_words<UINT16>(m_capacity << 1);
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_two_bytes[i] = m_inline[i];
+        }
+    } else { // the allocator preserves the contents and zeroes the new half
+        m_two_bytes = reallocate_words(m_two_bytes, m_capacity, m_capacity << 1);
     }
-    delete[] old_buffer;
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::reallocations, 1));
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, m_capacity * sizeof(UINT16)));
     m_capacity <<= 1;
-}
\ No newline at end of file
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT16)));
+}
+
+UINT16* Bitstream16::acquire_buffer(UINT64 min_size, UINT64 &size) {
+    UINT64 slot = 0;
+    while(slot < m_free_count && m_free_sizes[slot] < min_size) {
+        slot++;
+    }
+    if (slot < m_free_count) { // reuse a returned buffer that is large enough, it has to be cleared first
+        UINT16* buffer = m_free_buffers[slot];
+        size = m_free_sizes[slot];
+        m_free_count--;
+        m_free_buffers[slot] = m_free_buffers[m_free_count];
+        m_free_sizes[slot] = m_free_sizes[m_free_count];
+        for(UINT64 i = 0; i < size; i++) {
+            buffer[i] = 0;
+        }
+        return buffer;
+    }
+    size = min_size;
+    return allocate_words<UINT16>(min_size);
+}
+
+void Bitstream16::hand_out_buffer(UINT16* &buffer, UINT64 &size) {
+    if (m_two_bytes != m_inline) {
+        buffer = m_two_bytes;
+        size = m_capacity;
+        return;
+    }
+    buffer = acquire_buffer(m_capacity, size);
+    for(UINT64 i = 0; i < m_capacity; i++) {
+        buffer[i] = m_two_bytes[i];
+    }
+}
+
+template<typename Source>
+void Bitstream16::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) { // reading from unallocated memory
+        return;
+    }
+    while(start_destination + no_bits_to_write > (m_capacity << 4)) {
+        double_capacity();
+    }
+    m_size = start_destination + no_bits_to_write > m_size ? start_destination + no_bits_to_write : m_size;
+    // the source is viewed once the destination has grown, as it may be the destination itself
+    copy_bit_range(reinterpret_cast<UINT8 *>(m_two_bytes), start_destination, source.template as<UINT8>().words(),
+                   start_source, no_bits_to_write);
+}
+
+template<typename Source>
+void Bitstream16::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+}
+
+template<typename Source>
+void Bitstream16::write_stream(UINT64 no_bits_to_write, Source &source) {
+    UINT64 start_source = source.pointer();
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+    source.increment_pointer(no_bits_to_write);
+}
+
+template<typename T>
+WordView<T> Bitstream16::as() {
+    while((m_capacity * sizeof(UINT16)) % sizeof(T)) { // pad the buffer to whole words of the view
+        double_capacity();
+    }
+    return WordView<T>(reinterpret_cast<T *>(m_two_bytes), m_capacity * sizeof(UINT16) / sizeof(T), m_size);
+}
+
+template<typename Source>
+bool Bitstream16::take(Source &source) {
+    if (!buffer_transferable(source)) {
+        return false;
+    }
+    UINT64 pointer = source.pointer();
+    UINT64 no_bits = source.size_bits();
+    typename Source::Word *buffer;
+    UINT64 size;
+    source.flush(buffer, size, 1);
+    UINT64 no_bytes = size * sizeof(typename Source::Word);
+    UINT64 padded_bytes = (no_bytes + sizeof(UINT16) - 1) & ~(sizeof(UINT16) - 1);
+    UINT8 *bytes = reinterpret_cast<UINT8 *>(buffer);
+    if (padded_bytes != no_bytes) { // the tail of the last word is zeroed by the allocator
+        bytes = reallocate_words(bytes, no_bytes, padded_bytes);
+    }
+    if (m_two_bytes != m_inline) {
+        release_words(m_two_bytes, m_capacity);
+    }
+    m_two_bytes = reinterpret_cast<UINT16 *>(bytes);
+    m_capacity = padded_bytes / sizeof(UINT16);
+    m_size = no_bits;
+    m_pointer = pointer;
+    return true;
+}
+
+// the supported instantiations, the interop members are defined here rather than in the header
+template WordView<UINT8> Bitstream16::as<UINT8>();
+template WordView<UINT16> Bitstream16::as<UINT16>();
+template WordView<UINT32> Bitstream16::as<UINT32>();
+template WordView<UINT64> Bitstream16::as<UINT64>();
+template void Bitstream16::write_stream<Bitstream8>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream16::write_stream<Bitstream8>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream16::write_stream<Bitstream8>(UINT64 no_bits_to_write, Bitstream8 &source);
+template bool Bitstream16::take<Bitstream8>(Bitstream8 &source);
+template void Bitstream16::write_stream<Bitstream32>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source);
+template void Bitstream16::write_stream<Bitstream32>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source);
+template void Bitstream16::write_stream<Bitstream32>(UINT64 no_bits_to_write, Bitstream32 &source);
+template bool Bitstream16::take<Bitstream32>(Bitstream32 &source);
+template void Bitstream16::write_stream<Bitstream64>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source);
+template void Bitstream16::write_stream<Bitstream64>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source);
+template void Bitstream16::write_stream<Bitstream64>(UINT64 no_bits_to_write, Bitstream64 &source);
+template bool Bitstream16::take<Bitstream64>(Bitstream64 &source);
@@ -1,43 +1,88 @@
-#include "Bitstream32.h"
+#include "bitstream32.h"
+#include "bitstream8.h"
+#include "bitstream16.h"
+#include "bitstream64.h"
 using namespace ezb;
 
 Bitstream32::Bitstream32(UINT64 no_bits) {
     m_pointer = 0;
+    m_size = 0;
+    m_free_count = 0;
     m_capacity = (no_bits >> 5) == 0 ? 1 : (no_bits >> 5);
-    m_four_bytes = new UINT32[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
-        m_four_bytes[i] = 0;
+    if (m_capacity <= INLINE_WORDS) { // small streams start in the inline buffer
+        m_capacity = INLINE_WORDS;
+        m_four_bytes = m_inline;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_four_bytes[i] = 0;
+        }
+    } else {
+        m_four_bytes = allocate_words<UINT32>(m_capacity);
     }
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT32)));
 }
 
 Bitstream32::~Bitstream32() {
-    delete m_four_bytes;
+    if (m_four_bytes != m_inline) {
+        release_words(m_four_bytes, m_capacity);
+    }
+    for(UINT64 i = 0; i < m_free_count; i++) {
+        release_words(m_free_buffers[i], m_free_sizes[i]);
+    }
 }
 
 Bitstream32::Bitstream32(const Bitstream32 &other) {
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_four_bytes = new UINT32[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_free_count = 0;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_four_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_four_bytes[i] = 0;
+        }
+    } else {
+        m_four_bytes = allocate_words<UINT32>(m_capacity);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_four_bytes[i] = other.m_four_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT32)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT32)));
 }
 
 Bitstream32 Bitstream32::operator=(const Bitstream32 &other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (m_four_bytes != m_inline) {
+        release_words(m_four_bytes, m_capacity);
+    }
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_four_bytes = new UINT32[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_four_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_four_bytes[i] = 0;
+        }
+    } else {
+        m_four_bytes = allocate_words<UINT32>(m_capacity);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_four_bytes[i] = other.m_four_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT32)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT32)));
     return *this;
 }
 
 void Bitstream32::set_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_four_bytes[(idx >> 5)] |= 0b1ull << (idx & 0b11111ull);
 }
 
 void Bitstream32::clear_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_four_bytes[(idx >> 5)] &= ~(0b1ull << ((idx & 0b11111ull)));
 }
 
@@ -48,7 +93,7 @@ bool Bitstream32::get_bit(UINT64 idx) {
 UINT32 Bitstream32::read_word(UINT64 start, UINT8 no_bits_to_read) {
     UINT64 word_idx = start >> 5;
     UINT64 bit_start_offset = start & 0b11111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - start + 1) & 0b11111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_read - 1) & 0b11111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_four_bytes[word_idx] & MASK_SHIFT_32_RIGHT[32-no_bits_to_read];
     }
@@ -56,14 +101,15 @@ UINT32 Bitstream32::read_word(UINT64 start, UINT8 no_bits_to_read) {
         return (m_four_bytes[word_idx] & (MASK_SHIFT_32_LEFT[bit_start_offset] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_four_bytes[word_idx] & MASK_SHIFT_32_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_four_bytes[word_idx + 1] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset]) << (32-bit_end_offset));
+            ((m_four_bytes[word_idx + 1] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset]) << (32-bit_start_offset));
 }
 
 UINT32 Bitstream32::read_word(UINT8 no_bits_to_read) {
     UINT64 word_idx = m_pointer >> 5;
     UINT64 bit_start_offset = m_pointer & 0b11111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - m_pointer + 1) & 0b11111ull;
+    UINT64 bit_end_offset = (m_pointer + no_bits_to_read - 1) & 0b11111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_four_bytes[word_idx] & MASK_SHIFT_32_RIGHT[32-no_bits_to_read];
     }
@@ -71,17 +117,20 @@ UINT32 Bitstream32::read_word(UINT8 no_bits_to_read) {
         return (m_four_bytes[word_idx] & (MASK_SHIFT_32_LEFT[bit_start_offset] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_four_bytes[word_idx] & MASK_SHIFT_32_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_four_bytes[word_idx + 1] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset]) << (32-bit_end_offset));
+            ((m_four_bytes[word_idx + 1] & MASK_SHIFT_32_RIGHT[31 - bit_end_offset]) << (32-bit_start_offset));
 }
 
 void Bitstream32::write_word(UINT64 start, UINT32 data, UINT8 no_bits_to_write) {
     while(start + no_bits_to_write > (m_capacity << 5)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 word_idx = start >> 5;
     UINT64 bit_start_offset = start & 0b11111ull;
     UINT64 bit_end_offset = (start + no_bits_to_write - 1) & 0b11111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_four_bytes[word_idx] &= MASK_SHIFT_32_LEFT[no_bits_to_write];
@@ -96,6 +145,7 @@ void Bitstream32::write_word(UINT64 start, UINT32 data, UINT8 no_bits_to_write)
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_four_bytes[word_idx] &= ~MASK_SHIFT_32_LEFT[bit_start_offset];
     m_four_bytes[word_idx++] |= (data << bit_start_offset);
     m_four_bytes[word_idx] &= MASK_SHIFT_32_LEFT[++bit_end_offset];
@@ -106,9 +156,11 @@ void Bitstream32::write_word(UINT32 data, UINT8 no_bits_to_write) {
     while(m_pointer + no_bits_to_write > (m_capacity << 5)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 word_idx = m_pointer >> 5;
     UINT64 bit_start_offset = m_pointer & 0b11111ull;
     UINT64 bit_end_offset = (m_pointer + no_bits_to_write - 1) & 0b11111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_four_bytes[word_idx] &= MASK_SHIFT_32_LEFT[no_bits_to_write];
@@ -124,6 +176,7 @@ void Bitstream32::write_word(UINT32 data, UINT8 no_bits_to_write) {
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_four_bytes[word_idx] &= ~MASK_SHIFT_32_LEFT[bit_start_offset];
     m_four_bytes[word_idx++] |= (data << bit_start_offset);
     m_four_bytes[word_idx] &= MASK_SHIFT_32_LEFT[++bit_end_offset];
@@ -135,8 +188,11 @@ void Bitstream32::write_buffer(UINT64 start, UINT32* data, UINT64 data_size, UIN
     while(start + no_bits_to_write > (m_capacity << 5)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 bit_offset = start & 0b11111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 5));
         // write the first no_bits_to_write / 32 words to the bitstream
         UINT64 cur_word = start >> 5;
         UINT64 i;
@@ -164,6 +220,7 @@ void Bitstream32::write_buffer(UINT64 start, UINT32* data, UINT64 data_size, UIN
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = start >> 5;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 5); i++) {
@@ -182,8 +239,11 @@ void Bitstream32::write_buffer(UINT32* data, UINT64 data_size, UINT64 no_bits_to
     while(m_pointer + no_bits_to_write > (m_capacity << 5)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 bit_offset = m_pointer & 0b11111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 5));
         // write the first no_bits_to_write / 32 words to the bitstream
         UINT64 cur_word = m_pointer >> 5;
         UINT64 i;
@@ -211,6 +271,7 @@ void Bitstream32::write_buffer(UINT32* data, UINT64 data_size, UINT64 no_bits_to
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = m_pointer >> 5;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 5); i++) {
@@ -227,199 +288,76 @@ void Bitstream32::write_buffer(UINT32* data, UINT64 data_size, UINT64 no_bits_to
 }
 
 void Bitstream32::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 5)) { // reading from unallocated memory
-        return;
-    }
-    while(start_destination + no_bits_to_write > (m_capacity << 5)) {
-        double_capacity();
-    }
-    // try to word align the source by writing 32 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 32 - (start_source & 0b11111ull) ? no_bits_to_write : 32 - no_bits_to_write;
-    UINT32 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(start_destination, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    start_destination += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
-
-    UINT64 bit_offset_dst = start_destination & 0b11111ull;
-    //UINT64 bit_offset_src = start_source & 0b11111ull; // at this point bit_offset_src is zero
-
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 5;
-        UINT64 cur_word_src = start_source >> 5;
-        for (i = 0; i < (no_bits_to_write >> 5); i++) { // just copy the words until boundary
-            m_four_bytes[cur_word_dst++] = source.m_four_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bits_left];
-            m_four_bytes[cur_word_dst] |= source.m_four_bytes[cur_word_src] & MASK_SHIFT_32_RIGHT[32 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 5;
-        UINT64 cur_word_src = start_source >> 5;
-        for(i = 0; i < (no_bits_to_write >> 5); i++) { // writes will always span two words
-            m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-            m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src] << bit_offset_dst);
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bit_offset_dst - 1];
-            m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src++] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b11111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT32 mask = MASK_SHIFT_32_LEFT[bit_offset_dst] & MASK_SHIFT_32_RIGHT[31-end_offset];
-                m_four_bytes[cur_word_dst] &= ~mask;
-                m_four_bytes[cur_word_dst] |= mask & (source.m_four_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-                m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src]  << bit_offset_dst);
-                m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[++end_offset];
-                m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[end_offset];
-            }
-        }
-    }
+    // the same copy as for the other widths, source may be this stream
+    write_stream<Bitstream32>(start_destination, start_source, no_bits_to_write, source);
 }
 
 void Bitstream32::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 5)) { // reading from unallocated memory
-        return;
-    }
-    while(m_pointer + no_bits_to_write > (m_capacity << 5)) {
-        double_capacity();
-    }
-    // try to word align the source by writing 32 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 32 - (start_source & 0b11111ull) ? no_bits_to_write : 32 - no_bits_to_write;
-    UINT32 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    m_pointer += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
+    write_stream<Bitstream32>(start_source, no_bits_to_write, source);
+}
 
-    UINT64 bit_offset_dst = m_pointer & 0b11111ull;
-    //UINT64 bit_offset_src = start_source & 0b11111ull; // at this point bit_offset_src is zero
+void Bitstream32::write_stream(UINT64 no_bits_to_write, Bitstream32 &source) {
+    write_stream<Bitstream32>(no_bits_to_write, source);
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 5;
-        UINT64 cur_word_src = start_source >> 5;
-        for (i = 0; i < (no_bits_to_write >> 5); i++) { // just copy the words until boundary
-            m_four_bytes[cur_word_dst++] = source.m_four_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bits_left];
-            m_four_bytes[cur_word_dst] |= source.m_four_bytes[cur_word_src] & MASK_SHIFT_32_RIGHT[32 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 5;
-        UINT64 cur_word_src = start_source >> 5;
-        for(i = 0; i < (no_bits_to_write >> 5); i++) { // writes will always span two words
-            m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-            m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src] << bit_offset_dst);
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bit_offset_dst - 1];
-            m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src++] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b11111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT32 mask = MASK_SHIFT_32_LEFT[bit_offset_dst] & MASK_SHIFT_32_RIGHT[31-end_offset];
-                m_four_bytes[cur_word_dst] &= ~mask;
-                m_four_bytes[cur_word_dst] |= mask & (source.m_four_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-                m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src]  << bit_offset_dst);
-                m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[++end_offset];
-                m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[end_offset];
-            }
+void Bitstream32::flush(UINT32* &buffer, UINT64 &size, UINT64 new_capacity) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    hand_out_buffer(buffer, size);
+    if (new_capacity <= INLINE_WORDS) {
+        m_four_bytes = m_inline;
+        m_capacity = INLINE_WORDS;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_four_bytes[i] = 0;
         }
+    } else {
+        m_four_bytes = acquire_buffer(new_capacity, m_capacity);
     }
-    m_pointer += no_bits_to_write;
+    m_pointer = 0;
+    m_size = 0;
 }
 
-void Bitstream32::write_stream(UINT64 no_bits_to_write, Bitstream32 &source) {
-    if(source.m_pointer + no_bits_to_write > (source.m_capacity << 5)) { // reading from unallocated memory
+void Bitstream32::flush(UINT32* &buffer, UINT64 &size, UINT32* replacement, UINT64 replacement_size) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    UINT64 i = 0;
+    if (m_four_bytes == m_inline && replacement_size >= m_capacity) {
+        // keep the inline buffer and hand its contents out in the replacement instead of allocating a copy
+        buffer = replacement;
+        size = replacement_size;
+        for(; i < m_capacity; i++) {
+            buffer[i] = m_four_bytes[i];
+            m_four_bytes[i] = 0;
+        }
+        for(; i < size; i++) {
+            buffer[i] = 0;
+        }
+        m_pointer = 0;
+        m_size = 0;
         return;
     }
-    while(m_pointer + no_bits_to_write > (m_capacity << 5)) {
-        double_capacity();
+    hand_out_buffer(buffer, size);
+    m_four_bytes = replacement;
+    m_capacity = replacement_size;
+    for(; i < m_capacity; i++) {
+        m_four_bytes[i] = 0;
     }
-    // try to word align the source by writing 32 - source.m_pointer bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 32 - (source.m_pointer & 0b11111ull) ? no_bits_to_write : 32 - no_bits_to_write;
-    UINT32 initial_source_data = source.read_word(source.m_pointer, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    m_pointer += initial_bits_to_write;
-    source.m_pointer += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
-
-    UINT64 bit_offset_dst = m_pointer & 0b11111ull;
-    //UINT64 bit_offset_src = start_source & 0b11111ull; // at this point bit_offset_src is zero
+    m_pointer = 0;
+    m_size = 0;
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 5;
-        UINT64 cur_word_src = source.m_pointer >> 5;
-        for (i = 0; i < (no_bits_to_write >> 5); i++) { // just copy the words until boundary
-            m_four_bytes[cur_word_dst++] = source.m_four_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bits_left];
-            m_four_bytes[cur_word_dst] |= source.m_four_bytes[cur_word_src] & MASK_SHIFT_32_RIGHT[32 - bits_left];
-        }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 5;
-        UINT64 cur_word_src = source.m_pointer >> 5;
-        for(i = 0; i < (no_bits_to_write >> 5); i++) { // writes will always span two words
-            m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-            m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src] << bit_offset_dst);
-            m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[bit_offset_dst - 1];
-            m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src++] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b11111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b11111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT32 mask = MASK_SHIFT_32_LEFT[bit_offset_dst] & MASK_SHIFT_32_RIGHT[31-end_offset];
-                m_four_bytes[cur_word_dst] &= ~mask;
-                m_four_bytes[cur_word_dst] |= mask & (source.m_four_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_four_bytes[cur_word_dst] &= ~MASK_SHIFT_32_LEFT[bit_offset_dst];
-                m_four_bytes[cur_word_dst++] |= (source.m_four_bytes[cur_word_src]  << bit_offset_dst);
-                m_four_bytes[cur_word_dst] &= MASK_SHIFT_32_LEFT[++end_offset];
-                m_four_bytes[cur_word_dst] |= (source.m_four_bytes[cur_word_src] >> (32 - bit_offset_dst)) & ~MASK_SHIFT_32_LEFT[end_offset];
-            }
-        }
+void Bitstream32::return_buffer(UINT32* buffer, UINT64 size) {
+    if (m_free_count == EZB_FREE_LIST_SLOTS) { // free list is full, release the buffer
+        release_words(buffer, size);
+        return;
     }
-    m_pointer += no_bits_to_write;
-    source.m_pointer += no_bits_to_write;
+    m_free_buffers[m_free_count] = buffer;
+    m_free_sizes[m_free_count] = size;
+    m_free_count++;
 }
 
-void Bitstream32::flush(UINT32* &buffer, UINT64 &size, UINT64 new_capacity) {
-    buffer = m_four_bytes;
-    size = m_capacity;
-    m_four_bytes = new UINT32[new_capacity];
-    m_capacity = new_capacity;
+void Bitstream32::flush_trimmed(UINT32* &buffer, UINT64 &size, UINT64 &words_used, UINT64 &bits_used, UINT64 new_capacity) {
+    bits_used = m_size;
+    words_used = (m_size + 31) >> 5;
+    flush(buffer, size, new_capacity);
 }
 
 void Bitstream32::increment_pointer(UINT64 increment) {
@@ -442,16 +380,147 @@ UINT64 Bitstream32::capacity() {
     return m_capacity;
 }
 
+UINT64 Bitstream32::size_bits() {
+    return m_size;
+}
+
+BitstreamStats Bitstream32::stats() {
+#ifdef EZB_ENABLE_STATS
+    return m_stats;
+#else
+    return BitstreamStats();
+#endif
+}
+
 void Bitstream32::double_capacity() {
-    UINT32* old_buffer = m_four_bytes;
-    m_four_bytes = new UINT32[m_capacity << 1];
-    UINT64 i = 0;
-    for(; i < m_capacity; i++) {
-        m_four_bytes[i] = old_buffer[i];
-    }
-    for(; i < (m_capacity << 1); i++) {
-        m_four_bytes[i] = 0;
+    if (m_four_bytes == m_inline) {
+        m_four_bytes = allocate_words<UINT32>(m_capacity << 1);
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_four_bytes[i] = m_inline[i];
+        }
+    } else { // the allocator preserves the contents and zeroes the new half
+        m_four_bytes = reallocate_words(m_four_bytes, m_capacity, m_capacity << 1);
     }
-    delete[] old_buffer;
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::reallocations, 1));
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, m_capacity * sizeof(UINT32)));
     m_capacity <<= 1;
-}
\ No newline at end of file
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT32)));
+}
+
+UINT32* Bitstream32::acquire_buffer(UINT64 min_size, UINT64 &size) {
+    UINT64 slot = 0;
+    while(slot < m_free_count && m_free_sizes[slot] < min_size) {
+        slot++;
+    }
+    if (slot < m_free_count) { // reuse a returned buffer that is large enough, it has to be cleared first
+        UINT32* buffer = m_free_buffers[slot];
+        size = m_free_sizes[slot];
+        m_free_count--;
+        m_free_buffers[slot] = m_free_buffers[m_free_count];
+        m_free_sizes[slot] = m_free_sizes[m_free_count];
+        for(UINT64 i = 0; i < size; i++) {
+            buffer[i] = 0;
+        }
+        return buffer;
+    }
+    size = min_size;
+    return allocate_words<UINT32>(min_size);
+}
+
+void Bitstream32::hand_out_buffer(UINT32* &buffer, UINT64 &size) {
+    if (m_four_bytes != m_inline) {
+        buffer = m_four_bytes;
+        size = m_capacity;
+        return;
+    }
+    buffer = acquire_buffer(m_capacity, size);
+    for(UINT64 i = 0; i < m_capacity; i++) {
+        buffer[i] = m_four_bytes[i];
+    }
+}
+
+template<typename Source>
+void Bitstream32::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) { // reading from unallocated memory
+        return;
+    }
+    while(start_destination + no_bits_to_write > (m_capacity << 5)) {
+        double_capacity();
+    }
+    m_size = start_destination + no_bits_to_write > m_size ? start_destination + no_bits_to_write : m_size;
+    // the source is viewed once the destination has grown, as it may be the destination itself
+    copy_bit_range(reinterpret_cast<UINT8 *>(m_four_bytes), start_destination, source.template as<UINT8>().words(),
+                   start_source, no_bits_to_write);
+}
+
+template<typename Source>
+void Bitstream32::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+}
+
+template<typename Source>
+void Bitstream32::write_stream(UINT64 no_bits_to_write, Source &source) {
+    UINT64 start_source = source.pointer();
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+    source.increment_pointer(no_bits_to_write);
+}
+
+template<typename T>
+WordView<T> Bitstream32::as() {
+    while((m_capacity * sizeof(UINT32)) % sizeof(T)) { // pad the buffer to whole words of the view
+        double_capacity();
+    }
+    return WordView<T>(reinterpret_cast<T *>(m_four_bytes), m_capacity * sizeof(UINT32) / sizeof(T), m_size);
+}
+
+template<typename Source>
+bool Bitstream32::take(Source &source) {
+    if (!buffer_transferable(source)) {
+        return false;
+    }
+    UINT64 pointer = source.pointer();
+    UINT64 no_bits = source.size_bits();
+    typename Source::Word *buffer;
+    UINT64 size;
+    source.flush(buffer, size, 1);
+    UINT64 no_bytes = size * sizeof(typename Source::Word);
+    UINT64 padded_bytes = (no_bytes + sizeof(UINT32) - 1) & ~(sizeof(UINT32) - 1);
+    UINT8 *bytes = reinterpret_cast<UINT8 *>(buffer);
+    if (padded_bytes != no_bytes) { // the tail of the last word is zeroed by the allocator
+        bytes = reallocate_words(bytes, no_bytes, padded_bytes);
+    }
+    if (m_four_bytes != m_inline) {
+        release_words(m_four_bytes, m_capacity);
+    }
+    m_four_bytes = reinterpret_cast<UINT32 *>(bytes);
+    m_capacity = padded_bytes / sizeof(UINT32);
+    m_size = no_bits;
+    m_pointer = pointer;
+    return true;
+}
+
+// the supported instantiations, the interop members are defined here rather than in the header
+template WordView<UINT8> Bitstream32::as<UINT8>();
+template WordView<UINT16> Bitstream32::as<UINT16>();
+template WordView<UINT32> Bitstream32::as<UINT32>();
+template WordView<UINT64> Bitstream32::as<UINT64>();
+template void Bitstream32::write_stream<Bitstream8>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream32::write_stream<Bitstream8>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream32::write_stream<Bitstream8>(UINT64 no_bits_to_write, Bitstream8 &source);
+template bool Bitstream32::take<Bitstream8>(Bitstream8 &source);
+template void Bitstream32::write_stream<Bitstream16>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source);
+template void Bitstream32::write_stream<Bitstream16>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source);
+template void Bitstream32::write_stream<Bitstream16>(UINT64 no_bits_to_write, Bitstream16 &source);
+template bool Bitstream32::take<Bitstream16>(Bitstream16 &source);
+template void Bitstream32::write_stream<Bitstream64>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source);
+template void Bitstream32::write_stream<Bitstream64>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source);
+template void Bitstream32::write_stream<Bitstream64>(UINT64 no_bits_to_write, Bitstream64 &source);
+template bool Bitstream32::take<Bitstream64>(Bitstream64 &source);
@@ -1,43 +1,99 @@
 #include "bitstream64.h"
+#include "bitstream8.h"
+#include "bitstream16.h"
+#include "bitstream32.h"
+#include <thread>
+#include <vector>
 using namespace ezb;
 
-Bitstream64::Bitstream64(UINT64 no_bits) {
+Bitstream64::Bitstream64(UINT64 no_bits) : Bitstream64(no_bits, AllocationOptions()) {
+}
+
+Bitstream64::Bitstream64(UINT64 no_bits, const AllocationOptions &options) : m_options(options) {
     m_pointer = 0;
+    m_size = 0;
+    m_free_count = 0;
     m_capacity = (no_bits >> 6) == 0 ? 1 : (no_bits >> 6);
-    m_eight_bytes = new UINT64[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
-        m_eight_bytes[i] = 0ull;
+    if (m_capacity <= INLINE_WORDS) { // small streams start in the inline buffer
+        m_capacity = INLINE_WORDS;
+        m_eight_bytes = m_inline;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_eight_bytes[i] = 0ull;
+        }
+    } else {
+        m_eight_bytes = allocate_words<UINT64>(m_capacity, m_options);
     }
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT64)));
 }
 
 Bitstream64::~Bitstream64() {
-    delete m_eight_bytes;
+    if (m_eight_bytes != m_inline) {
+        release_words(m_eight_bytes, m_capacity, m_options);
+    }
+    for(UINT64 i = 0; i < m_free_count; i++) {
+        release_words(m_free_buffers[i], m_free_sizes[i], m_options);
+    }
 }
 
-Bitstream64::Bitstream64(const Bitstream64 &other) {
+Bitstream64::Bitstream64(const Bitstream64 &other) : m_options(other.m_options) {
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_eight_bytes = new UINT64[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_free_count = 0;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_eight_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_eight_bytes[i] = 0ull;
+        }
+    } else {
+        m_eight_bytes = allocate_words<UINT64>(m_capacity, m_options);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_eight_bytes[i] = other.m_eight_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT64)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT64)));
 }
 
 Bitstream64 Bitstream64::operator=(const Bitstream64 &other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (m_eight_bytes != m_inline) {
+        release_words(m_eight_bytes, m_capacity, m_options);
+    }
+    // the buffers kept for reuse were allocated under the old options, release them before the options change
+    for(UINT64 i = 0; i < m_free_count; i++) {
+        release_words(m_free_buffers[i], m_free_sizes[i], m_options);
+    }
+    m_free_count = 0;
+    m_options = other.m_options;
     m_pointer = other.m_pointer;
-    m_capacity = other.m_capacity;
-    m_eight_bytes = new UINT64[m_capacity];
-    for(UINT64 i = 0; i < m_capacity; i++) {
+    m_size = other.m_size;
+    m_capacity = other.m_capacity > INLINE_WORDS ? other.m_capacity : INLINE_WORDS;
+    if (m_capacity == INLINE_WORDS) {
+        m_eight_bytes = m_inline;
+        for(UINT64 i = other.m_capacity; i < m_capacity; i++) {
+            m_eight_bytes[i] = 0ull;
+        }
+    } else {
+        m_eight_bytes = allocate_words<UINT64>(m_capacity, m_options);
+    }
+    for(UINT64 i = 0; i < other.m_capacity; i++) {
         m_eight_bytes[i] = other.m_eight_bytes[i];
     }
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, other.m_capacity * sizeof(UINT64)));
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT64)));
     return *this;
 }
 
 void Bitstream64::set_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_eight_bytes[(idx >> 6)] |= 0b1ull << (idx & 0b111111ull);
 }
 
 void Bitstream64::clear_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
     m_eight_bytes[(idx >> 6)] &= ~(0b1ull << ((idx & 0b111111ull)));
 }
 
@@ -48,7 +104,7 @@ bool Bitstream64::get_bit(UINT64 idx) {
 UINT64 Bitstream64::read_word(UINT64 start, UINT8 no_bits_to_read) {
     UINT64 word_idx = start >> 6;
     UINT64 bit_start_offset = start & 0b111111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - start + 1) & 0b111111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_read - 1) & 0b111111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_eight_bytes[word_idx] & MASK_SHIFT_64_RIGHT[64-no_bits_to_read];
     }
@@ -56,14 +112,15 @@ UINT64 Bitstream64::read_word(UINT64 start, UINT8 no_bits_to_read) {
         return (m_eight_bytes[word_idx] & (MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_eight_bytes[word_idx] & MASK_SHIFT_64_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_eight_bytes[word_idx + 1] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64-bit_end_offset));
+            ((m_eight_bytes[word_idx + 1] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64-bit_start_offset));
 }
 
 UINT64 Bitstream64::read_word(UINT8 no_bits_to_read) {
     UINT64 word_idx = m_pointer >> 6;
     UINT64 bit_start_offset = m_pointer & 0b111111ull;
-    UINT64 bit_end_offset = (no_bits_to_read - m_pointer + 1) & 0b111111ull;
+    UINT64 bit_end_offset = (m_pointer + no_bits_to_read - 1) & 0b111111ull;
     if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
         return m_eight_bytes[word_idx] & MASK_SHIFT_64_RIGHT[64-no_bits_to_read];
     }
@@ -71,17 +128,20 @@ UINT64 Bitstream64::read_word(UINT8 no_bits_to_read) {
         return (m_eight_bytes[word_idx] & (MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset])) >> bit_start_offset;
     }
     // else, the read is split on two words: read the relevant section from both and combine
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     return  ((m_eight_bytes[word_idx] & MASK_SHIFT_64_LEFT[bit_start_offset]) >> (bit_start_offset)) |
-            ((m_eight_bytes[word_idx + 1] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64-bit_end_offset));
+            ((m_eight_bytes[word_idx + 1] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64-bit_start_offset));
 }
 
 void Bitstream64::write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
     while(start + no_bits_to_write > (m_capacity << 6)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 word_idx = start >> 6;
     UINT64 bit_start_offset = start & 0b111111ull;
     UINT64 bit_end_offset = (start + no_bits_to_write - 1) & 0b111111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_eight_bytes[word_idx] &= MASK_SHIFT_64_LEFT[no_bits_to_write];
@@ -96,6 +156,7 @@ void Bitstream64::write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write)
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_eight_bytes[word_idx] &= ~MASK_SHIFT_64_LEFT[bit_start_offset];
     m_eight_bytes[word_idx++] |= (data << bit_start_offset);
     m_eight_bytes[word_idx] &= MASK_SHIFT_64_LEFT[++bit_end_offset];
@@ -106,9 +167,11 @@ void Bitstream64::write_word(UINT64 data, UINT8 no_bits_to_write) {
     while(m_pointer + no_bits_to_write > (m_capacity << 6)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 word_idx = m_pointer >> 6;
     UINT64 bit_start_offset = m_pointer & 0b111111ull;
     UINT64 bit_end_offset = (m_pointer + no_bits_to_write - 1) & 0b111111ull;
+    EZB_STAT(stats::add(m_stats, bit_start_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
 
     if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
         m_eight_bytes[word_idx] &= MASK_SHIFT_64_LEFT[no_bits_to_write];
@@ -124,6 +187,7 @@ void Bitstream64::write_word(UINT64 data, UINT8 no_bits_to_write) {
         return;
     }
     // write to two adjacent words
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
     m_eight_bytes[word_idx] &= ~MASK_SHIFT_64_LEFT[bit_start_offset];
     m_eight_bytes[word_idx++] |= (data << bit_start_offset);
     m_eight_bytes[word_idx] &= MASK_SHIFT_64_LEFT[++bit_end_offset];
@@ -135,15 +199,18 @@ void Bitstream64::write_buffer(UINT64 start, UINT64* data, UINT64 data_size, UIN
     while(start + no_bits_to_write > (m_capacity << 6)) {
         double_capacity();
     }
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
     UINT64 bit_offset = start & 0b111111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 6));
         // write the first no_bits_to_write / 64 words to the bitstream
         UINT64 cur_word = start >> 6;
         UINT64 i;
-        for (i = 0; i < (no_bits_to_write << 6); i++) {
+        for (i = 0; i < (no_bits_to_write >> 6); i++) {
             m_eight_bytes[cur_word] &= ~MASK_SHIFT_64_LEFT[bit_offset];
             m_eight_bytes[cur_word++] |= (data[i] << bit_offset);
-            m_eight_bytes[cur_word] &= MASK_SHIFT_64_LEFT[bit_offset - 1];
+            m_eight_bytes[cur_word] &= MASK_SHIFT_64_LEFT[bit_offset];
             m_eight_bytes[cur_word] |= (data[i] >> (64 - bit_offset)) & ~MASK_SHIFT_64_LEFT[bit_offset];
         }
         // write remaining bits, if any
@@ -164,6 +231,7 @@ void Bitstream64::write_buffer(UINT64 start, UINT64* data, UINT64 data_size, UIN
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = start >> 6;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 6); i++) {
@@ -182,15 +250,18 @@ void Bitstream64::write_buffer(UINT64* data, UINT64 data_size, UINT64 no_bits_to
     while(m_pointer + no_bits_to_write > (m_capacity << 6)) {
         double_capacity();
     }
+    m_size = m_pointer + no_bits_to_write > m_size ? m_pointer + no_bits_to_write : m_size;
     UINT64 bit_offset = m_pointer & 0b111111ull;
     if (bit_offset) { // unaligned write to the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::unaligned_writes, 1));
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, no_bits_to_write >> 6));
         // write the first no_bits_to_write / 64 words to the bitstream
         UINT64 cur_word = m_pointer >> 6;
         UINT64 i;
-        for (i = 0; i < (no_bits_to_write << 6); i++) {
+        for (i = 0; i < (no_bits_to_write >> 6); i++) {
             m_eight_bytes[cur_word] &= ~MASK_SHIFT_64_LEFT[bit_offset];
             m_eight_bytes[cur_word++] |= (data[i] << bit_offset);
-            m_eight_bytes[cur_word] &= MASK_SHIFT_64_LEFT[bit_offset - 1];
+            m_eight_bytes[cur_word] &= MASK_SHIFT_64_LEFT[bit_offset];
             m_eight_bytes[cur_word] |= (data[i] >> (64 - bit_offset)) & ~MASK_SHIFT_64_LEFT[bit_offset];
         }
         // write remaining bits, if any
@@ -201,7 +272,6 @@ void Bitstream64::write_buffer(UINT64* data, UINT64 data_size, UINT64 no_bits_to
                 UINT64 mask = MASK_SHIFT_64_LEFT[bit_offset] & MASK_SHIFT_64_RIGHT[63-end_offset];
                 m_eight_bytes[cur_word] &= ~mask;
                 m_eight_bytes[cur_word] |= mask & (data[i] << (bit_offset));
-                return;
             } else {
                 // unaligned write split on the first and second word
                 m_eight_bytes[cur_word] &= ~MASK_SHIFT_64_LEFT[bit_offset];
@@ -211,6 +281,7 @@ void Bitstream64::write_buffer(UINT64* data, UINT64 data_size, UINT64 no_bits_to
             }
         }
     } else { // aligned write on the bitstream
+        EZB_STAT(stats::add(m_stats, &BitstreamStats::aligned_writes, 1));
         UINT64 cur_word = m_pointer >> 6;
         UINT64 i;
         for (i = 0; i < (no_bits_to_write >> 6); i++) {
@@ -227,199 +298,346 @@ void Bitstream64::write_buffer(UINT64* data, UINT64 data_size, UINT64 no_bits_to
 }
 
 void Bitstream64::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 6)) { // reading from unallocated memory
+    // the same copy as for the other widths, source may be this stream
+    write_stream<Bitstream64>(start_destination, start_source, no_bits_to_write, source);
+}
+
+void Bitstream64::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source) {
+    write_stream<Bitstream64>(start_source, no_bits_to_write, source);
+}
+
+void Bitstream64::write_stream(UINT64 no_bits_to_write, Bitstream64 &source) {
+    write_stream<Bitstream64>(no_bits_to_write, source);
+}
+
+void Bitstream64::write_packed(const UINT64 *values, UINT64 no_values, UINT8 bits_per_value) {
+    UINT64 end = m_pointer + no_values * bits_per_value;
+    if (end == m_pointer) { // nothing to write, the word at the pointer may lie past the buffer
         return;
     }
-    while(start_destination + no_bits_to_write > (m_capacity << 6)) {
+    while(end > (m_capacity << 6)) {
         double_capacity();
     }
-    // try to word align the source by writing 64 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 64 - (start_source & 0b111111ull) ? no_bits_to_write : 64 - no_bits_to_write;
-    UINT64 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(start_destination, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    start_destination += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
-
-    UINT64 bit_offset_dst = start_destination & 0b111111ull;
-    //UINT64 bit_offset_src = start_source & 0b111111ull; // at this point bit_offset_src is zero
-
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 6;
-        UINT64 cur_word_src = start_source >> 6;
-        for (i = 0; i < (no_bits_to_write >> 6); i++) { // just copy the words until boundary
-            m_eight_bytes[cur_word_dst++] = source.m_eight_bytes[cur_word_src++];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bits_left];
-            m_eight_bytes[cur_word_dst] |= source.m_eight_bytes[cur_word_src] & MASK_SHIFT_64_RIGHT[64 - bits_left];
+    m_size = end > m_size ? end : m_size;
+    UINT64 word_idx = m_pointer >> 6;
+    UINT64 bit_offset = m_pointer & 0b111111ull;
+    // accumulate whole words, keeping the bits below the pointer
+    UINT64 word = m_eight_bytes[word_idx] & MASK_SHIFT_64_RIGHT[64 - bit_offset];
+    for (UINT64 i = 0; i < no_values; i++) {
+        UINT64 value = values[i] & MASK_SHIFT_64_RIGHT[64 - bits_per_value];
+        word |= value << bit_offset;
+        bit_offset += bits_per_value;
+        if (bit_offset >= 64) {
+            m_eight_bytes[word_idx++] = word;
+            bit_offset -= 64;
+            word = bit_offset ? value >> (bits_per_value - bit_offset) : 0;
         }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = start_destination >> 6;
-        UINT64 cur_word_src = start_source >> 6;
-        for(i = 0; i < (no_bits_to_write >> 6); i++) { // writes will always span two words
-            m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-            m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src] << bit_offset_dst);
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bit_offset_dst - 1];
-            m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src++] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[bit_offset_dst];
+    }
+    if (bit_offset) { // keep the bits after the last value
+        m_eight_bytes[word_idx] = (m_eight_bytes[word_idx] & MASK_SHIFT_64_LEFT[bit_offset]) | word;
+    }
+    m_pointer = end;
+}
+
+void Bitstream64::read_packed(UINT64 *values, UINT64 no_values, UINT8 bits_per_value) {
+    UINT64 word_idx = m_pointer >> 6;
+    UINT64 bit_offset = m_pointer & 0b111111ull;
+    UINT64 mask = MASK_SHIFT_64_RIGHT[64 - bits_per_value];
+    for (UINT64 i = 0; i < no_values; i++) {
+        UINT64 value = m_eight_bytes[word_idx] >> bit_offset;
+        bit_offset += bits_per_value;
+        if (bit_offset > 64) { // the value continues in the next word
+            value |= m_eight_bytes[word_idx + 1] << (bits_per_value - (bit_offset - 64));
         }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b111111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT64 mask = MASK_SHIFT_64_LEFT[bit_offset_dst] & MASK_SHIFT_64_RIGHT[63-end_offset];
-                m_eight_bytes[cur_word_dst] &= ~mask;
-                m_eight_bytes[cur_word_dst] |= mask & (source.m_eight_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-                m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src]  << bit_offset_dst);
-                m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[++end_offset];
-                m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[end_offset];
-            }
+        values[i] = value & mask;
+        if (bit_offset >= 64) {
+            word_idx++;
+            bit_offset -= 64;
         }
     }
+    m_pointer += no_values * bits_per_value;
 }
 
-void Bitstream64::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Bitstream64 &source) {
-    if(start_source + no_bits_to_write > (source.m_capacity << 6)) { // reading from unallocated memory
+void Bitstream64::write_fields(const UINT64 *values, const UINT8 *widths, UINT64 no_values) {
+    UINT64 total = 0;
+    for (UINT64 i = 0; i < no_values; i++) { // separate pass, vectorized by the compiler
+        total += widths[i];
+    }
+    UINT64 end = m_pointer + total;
+    if (end == m_pointer) {
         return;
     }
-    while(m_pointer + no_bits_to_write > (m_capacity << 6)) {
+    while(end > (m_capacity << 6)) {
         double_capacity();
     }
-    // try to word align the source by writing 64 - bit_offset_src bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 64 - (start_source & 0b111111ull) ? no_bits_to_write : 64 - no_bits_to_write;
-    UINT64 initial_source_data = source.read_word(start_source, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
-
-    m_pointer += initial_bits_to_write;
-    start_source += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
-
-    if (!no_bits_to_write) return; // nothing left to write, return
+    m_size = end > m_size ? end : m_size;
+    UINT64 word_idx = m_pointer >> 6;
+    UINT64 bit_offset = m_pointer & 0b111111ull;
+    UINT64 tail = m_eight_bytes[end >> 6 < m_capacity ? end >> 6 : m_capacity - 1]; // bits after the last value
+    // accumulate whole words, storing the accumulator on every value so that the loop has no unpredictable branch
+    // when the widths vary
+    UINT64 word = m_eight_bytes[word_idx] & MASK_SHIFT_64_RIGHT[64 - bit_offset];
+    for (UINT64 i = 0; i < no_values; i++) {
+        UINT64 width = widths[i];
+        UINT64 value = values[i] & MASK_SHIFT_64_RIGHT[64 - width];
+        word |= value << bit_offset;
+        m_eight_bytes[word_idx] = word;
+        UINT64 spill = (value >> 1) >> (63 - bit_offset); // bits of value past the end of the word
+        bit_offset += width;
+        UINT64 carry = bit_offset >> 6;
+        word = carry ? spill : word;
+        word_idx += carry;
+        bit_offset &= 0b111111ull;
+    }
+    if (bit_offset) {
+        m_eight_bytes[word_idx] = (tail & MASK_SHIFT_64_LEFT[bit_offset]) | word;
+    }
+    m_pointer = end;
+}
 
-    UINT64 bit_offset_dst = m_pointer & 0b111111ull;
-    //UINT64 bit_offset_src = start_source & 0b111111ull; // at this point bit_offset_src is zero
+void Bitstream64::read_fields(UINT64 *values, const UINT8 *widths, UINT64 no_values) {
+    UINT64 word_idx = m_pointer >> 6;
+    UINT64 bit_offset = m_pointer & 0b111111ull;
+    for (UINT64 i = 0; i < no_values; i++) {
+        UINT64 width = widths[i];
+        UINT64 value = m_eight_bytes[word_idx] >> bit_offset;
+        bit_offset += width;
+        if (bit_offset > 64) { // the value continues in the next word
+            value |= m_eight_bytes[word_idx + 1] << (width - (bit_offset - 64));
+        }
+        values[i] = value & MASK_SHIFT_64_RIGHT[64 - width];
+        if (bit_offset >= 64) {
+            word_idx++;
+            bit_offset -= 64;
+        }
+    }
+    m_pointer = (word_idx << 6) + bit_offset;
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 6;
-        UINT64 cur_word_src = start_source >> 6;
-        for (i = 0; i < (no_bits_to_write >> 6); i++) { // just copy the words until boundary
-            m_eight_bytes[cur_word_dst++] = source.m_eight_bytes[cur_word_src++];
+void Bitstream64::read_words(const UINT64 *offsets, UINT8 width, UINT64 *out, UINT64 no_offsets) {
+    UINT64 mask = MASK_SHIFT_64_RIGHT[64 - width];
+    for (UINT64 i = 0; i < no_offsets; i++) {
+        if (i + EZB_PREFETCH_DISTANCE < no_offsets) { // the last word too, in case the read crosses a cache line
+            UINT64 ahead = offsets[i + EZB_PREFETCH_DISTANCE];
+            prefetch(m_eight_bytes + (ahead >> 6));
+            prefetch(m_eight_bytes + ((ahead + width - 1) >> 6));
         }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bits_left];
-            m_eight_bytes[cur_word_dst] |= source.m_eight_bytes[cur_word_src] & MASK_SHIFT_64_RIGHT[64 - bits_left];
+        UINT64 word_idx = offsets[i] >> 6;
+        UINT64 bit_offset = offsets[i] & 0b111111ull;
+        UINT64 word = m_eight_bytes[word_idx] >> bit_offset;
+        if (bit_offset + width > 64) { // the read is split on two words
+            word |= m_eight_bytes[word_idx + 1] << (64 - bit_offset);
         }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 6;
-        UINT64 cur_word_src = start_source >> 6;
-        for(i = 0; i < (no_bits_to_write >> 6); i++) { // writes will always span two words
-            m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-            m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src] << bit_offset_dst);
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bit_offset_dst - 1];
-            m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src++] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[bit_offset_dst];
+        out[i] = word & mask;
+    }
+}
+
+void Bitstream64::write_words(const UINT64 *offsets, const UINT64 *values, UINT8 width, UINT64 no_offsets) {
+    UINT64 end = 0;
+    for (UINT64 i = 0; i < no_offsets; i++) {
+        end = offsets[i] + width > end ? offsets[i] + width : end;
+    }
+    while(end > (m_capacity << 6)) {
+        double_capacity();
+    }
+    m_size = end > m_size ? end : m_size;
+    UINT64 mask = MASK_SHIFT_64_RIGHT[64 - width];
+    for (UINT64 i = 0; i < no_offsets; i++) {
+        if (i + EZB_PREFETCH_DISTANCE < no_offsets) {
+            UINT64 ahead = offsets[i + EZB_PREFETCH_DISTANCE];
+            prefetch(m_eight_bytes + (ahead >> 6), true);
+            prefetch(m_eight_bytes + ((ahead + width - 1) >> 6), true);
         }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b111111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT64 mask = MASK_SHIFT_64_LEFT[bit_offset_dst] & MASK_SHIFT_64_RIGHT[63-end_offset];
-                m_eight_bytes[cur_word_dst] &= ~mask;
-                m_eight_bytes[cur_word_dst] |= mask & (source.m_eight_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-                m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src]  << bit_offset_dst);
-                m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[++end_offset];
-                m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[end_offset];
-            }
+        UINT64 word_idx = offsets[i] >> 6;
+        UINT64 bit_offset = offsets[i] & 0b111111ull;
+        UINT64 data = values[i] & mask;
+        m_eight_bytes[word_idx] = (m_eight_bytes[word_idx] & ~(mask << bit_offset)) | (data << bit_offset);
+        if (bit_offset + width > 64) { // the write is split on two words
+            m_eight_bytes[word_idx + 1] = (m_eight_bytes[word_idx + 1] & ~(mask >> (64 - bit_offset))) |
+                                          (data >> (64 - bit_offset));
         }
     }
-    m_pointer += no_bits_to_write;
 }
 
-void Bitstream64::write_stream(UINT64 no_bits_to_write, Bitstream64 &source) {
-    if(source.m_pointer + no_bits_to_write > (source.m_capacity << 6)) { // reading from unallocated memory
+void Bitstream64::set_bits(const UINT64 *indices, UINT64 no_indices) {
+    if (!no_indices) {
         return;
     }
-    while(m_pointer + no_bits_to_write > (m_capacity << 6)) {
+    UINT64 end = 0;
+    UINT64 word_idx = indices[0] >> 6;
+    UINT64 bits = 0;
+    for (UINT64 i = 0; i < no_indices; i++) {
+        if (i + EZB_PREFETCH_DISTANCE < no_indices) {
+            prefetch(m_eight_bytes + (indices[i + EZB_PREFETCH_DISTANCE] >> 6), true);
+        }
+        UINT64 idx = indices[i];
+        end = idx + 1 > end ? idx + 1 : end;
+        if (idx >> 6 != word_idx) { // apply the bits gathered for the previous word
+            m_eight_bytes[word_idx] |= bits;
+            word_idx = idx >> 6;
+            bits = 0;
+        }
+        bits |= 0b1ull << (idx & 0b111111ull);
+    }
+    m_eight_bytes[word_idx] |= bits;
+    m_size = end > m_size ? end : m_size;
+}
+
+UINT32 Bitstream64::crc32c(UINT64 start, UINT64 no_bits, UINT32 no_threads) {
+    UINT64 chunk = no_threads > 1 ? (no_bits / no_threads + 511) & ~511ull : no_bits; // whole 64-byte blocks
+    if (no_threads < 2 || chunk < (1ull << 22)) {
+        return range_crc32c(start, no_bits);
+    }
+    std::vector<UINT32> crcs(no_threads, 0);
+    std::vector<std::thread> workers;
+    for (UINT32 t = 1; t < no_threads && t * chunk < no_bits; t++) {
+        UINT64 size = no_bits - t * chunk < chunk ? no_bits - t * chunk : chunk;
+        workers.emplace_back([this, &crcs, start, t, chunk, size]() {
+            crcs[t] = range_crc32c(start + t * chunk, size);
+        });
+    }
+    UINT32 crc = range_crc32c(start, chunk);
+    for (UINT32 t = 1; t <= workers.size(); t++) { // combine the chunk CRCs in order
+        workers[t - 1].join();
+        UINT64 size = no_bits - t * chunk < chunk ? no_bits - t * chunk : chunk;
+        crc = crc32c_combine(crc, crcs[t], (size + 7) >> 3);
+    }
+    return crc;
+}
+
+UINT64 Bitstream64::hash64(UINT64 start, UINT64 no_bits, UINT64 seed) {
+    Hash64 hash(seed);
+    UINT64 chunk[256];
+    if (!(start & 0b111ull)) { // byte aligned, hash the bytes in place
+        hash.update(reinterpret_cast<UINT8 *>(m_eight_bytes) + (start >> 3), no_bits >> 3);
+        if (no_bits & 0b111ull) {
+            copy_bits(start + (no_bits & ~0b111ull), no_bits & 0b111ull, chunk);
+            hash.update(chunk, 1);
+        }
+        return hash.digest();
+    }
+    for (UINT64 done = 0; done < no_bits; done += 256 << 6) {
+        UINT64 bits = no_bits - done < (256 << 6) ? no_bits - done : (256 << 6);
+        copy_bits(start + done, bits, chunk);
+        hash.update(chunk, (bits + 7) >> 3);
+    }
+    return hash.digest();
+}
+
+void Bitstream64::write_morton2(UINT32 x, UINT32 y, UINT8 bits_per_dim) {
+    UINT8 no_bits = bits_per_dim << 1;
+    write_word(morton_encode2(x, y), no_bits);
+}
+
+void Bitstream64::write_morton3(UINT32 x, UINT32 y, UINT32 z, UINT8 bits_per_dim) {
+    UINT8 no_bits = bits_per_dim * 3;
+    write_word(morton_encode3(x, y, z), no_bits);
+}
+
+void Bitstream64::read_morton2(UINT32 &x, UINT32 &y, UINT8 bits_per_dim) {
+    morton_decode2(read_word(m_pointer, bits_per_dim << 1), x, y);
+    m_pointer += bits_per_dim << 1;
+}
+
+void Bitstream64::read_morton3(UINT32 &x, UINT32 &y, UINT32 &z, UINT8 bits_per_dim) {
+    morton_decode3(read_word(m_pointer, bits_per_dim * 3), x, y, z);
+    m_pointer += bits_per_dim * 3;
+}
+
+void Bitstream64::write_morton2(const UINT32 *x, const UINT32 *y, UINT64 no_keys, UINT8 bits_per_dim) {
+    UINT64 codes[256];
+    while(m_pointer + no_keys * (bits_per_dim << 1) > (m_capacity << 6)) { // grown once for all chunks
         double_capacity();
     }
-    // try to word align the source by writing 64 - source.m_pointer bits
-    UINT64 initial_bits_to_write = no_bits_to_write < 64 - (source.m_pointer & 0b111111ull) ? no_bits_to_write : 64 - no_bits_to_write;
-    UINT64 initial_source_data = source.read_word(source.m_pointer, initial_bits_to_write);
-    write_word(m_pointer, initial_source_data, initial_bits_to_write); // TODO inline this by hand
+    for (UINT64 i = 0; i < no_keys; i += 256) { // encode and pack in chunks that stay in L1
+        UINT64 no_codes = no_keys - i < 256 ? no_keys - i : 256;
+        morton_encode2(x + i, y + i, codes, no_codes);
+        write_packed(codes, no_codes, bits_per_dim << 1);
+    }
+}
 
-    m_pointer += initial_bits_to_write;
-    source.m_pointer += initial_bits_to_write;
-    no_bits_to_write -= initial_bits_to_write;
+void Bitstream64::write_morton3(const UINT32 *x, const UINT32 *y, const UINT32 *z, UINT64 no_keys, UINT8 bits_per_dim) {
+    UINT64 codes[256];
+    while(m_pointer + no_keys * bits_per_dim * 3 > (m_capacity << 6)) {
+        double_capacity();
+    }
+    for (UINT64 i = 0; i < no_keys; i += 256) {
+        UINT64 no_codes = no_keys - i < 256 ? no_keys - i : 256;
+        morton_encode3(x + i, y + i, z + i, codes, no_codes);
+        write_packed(codes, no_codes, bits_per_dim * 3);
+    }
+}
 
-    if (!no_bits_to_write) return; // nothing left to write, return
+void Bitstream64::read_morton2(UINT32 *x, UINT32 *y, UINT64 no_keys, UINT8 bits_per_dim) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        read_morton2(x[i], y[i], bits_per_dim);
+    }
+}
 
-    UINT64 bit_offset_dst = m_pointer & 0b111111ull;
-    //UINT64 bit_offset_src = start_source & 0b111111ull; // at this point bit_offset_src is zero
+void Bitstream64::read_morton3(UINT32 *x, UINT32 *y, UINT32 *z, UINT64 no_keys, UINT8 bits_per_dim) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        read_morton3(x[i], y[i], z[i], bits_per_dim);
+    }
+}
 
-    // at this point bit_offset_src is zero
-    if (!bit_offset_dst) { // write is word aligned on both buffers
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 6;
-        UINT64 cur_word_src = source.m_pointer >> 6;
-        for (i = 0; i < (no_bits_to_write >> 6); i++) { // just copy the words until boundary
-            m_eight_bytes[cur_word_dst++] = source.m_eight_bytes[cur_word_src++];
+void Bitstream64::flush(UINT64* &buffer, UINT64 &size, UINT64 new_capacity) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    hand_out_buffer(buffer, size);
+    if (new_capacity <= INLINE_WORDS) {
+        m_eight_bytes = m_inline;
+        m_capacity = INLINE_WORDS;
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_eight_bytes[i] = 0ull;
         }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if(bits_left) { // write the remaining bits to src
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bits_left];
-            m_eight_bytes[cur_word_dst] |= source.m_eight_bytes[cur_word_src] & MASK_SHIFT_64_RIGHT[64 - bits_left];
+    } else {
+        m_eight_bytes = acquire_buffer(new_capacity, m_capacity);
+    }
+    m_pointer = 0;
+    m_size = 0;
+}
+
+void Bitstream64::flush(UINT64* &buffer, UINT64 &size, UINT64* replacement, UINT64 replacement_size) {
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::flushes, 1));
+    UINT64 i = 0;
+    if (m_eight_bytes == m_inline && replacement_size >= m_capacity) {
+        // keep the inline buffer and hand its contents out in the replacement instead of allocating a copy
+        buffer = replacement;
+        size = replacement_size;
+        for(; i < m_capacity; i++) {
+            buffer[i] = m_eight_bytes[i];
+            m_eight_bytes[i] = 0ull;
         }
-    } else { // write is not aligned to the destination, but is aligned to the source
-        UINT64 i;
-        UINT64 cur_word_dst = m_pointer >> 6;
-        UINT64 cur_word_src = source.m_pointer >> 6;
-        for(i = 0; i < (no_bits_to_write >> 6); i++) { // writes will always span two words
-            m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-            m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src] << bit_offset_dst);
-            m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[bit_offset_dst - 1];
-            m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src++] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-        }
-        UINT64 bits_left = no_bits_to_write & 0b111111ull;
-        if (bits_left) {
-            UINT64 end_offset = (bit_offset_dst + bits_left - 1) & 0b111111ull;
-            if (bit_offset_dst <= end_offset) {
-                UINT64 mask = MASK_SHIFT_64_LEFT[bit_offset_dst] & MASK_SHIFT_64_RIGHT[63-end_offset];
-                m_eight_bytes[cur_word_dst] &= ~mask;
-                m_eight_bytes[cur_word_dst] |= mask & (source.m_eight_bytes[cur_word_src] << (bit_offset_dst));
-            } else {
-                // unaligned write split on the first and second word
-                m_eight_bytes[cur_word_dst] &= ~MASK_SHIFT_64_LEFT[bit_offset_dst];
-                m_eight_bytes[cur_word_dst++] |= (source.m_eight_bytes[cur_word_src]  << bit_offset_dst);
-                m_eight_bytes[cur_word_dst] &= MASK_SHIFT_64_LEFT[++end_offset];
-                m_eight_bytes[cur_word_dst] |= (source.m_eight_bytes[cur_word_src] >> (64 - bit_offset_dst)) & ~MASK_SHIFT_64_LEFT[end_offset];
-            }
+        for(; i < size; i++) {
+            buffer[i] = 0ull;
         }
+        m_pointer = 0;
+        m_size = 0;
+        return;
     }
-    m_pointer += no_bits_to_write;
-    source.m_pointer += no_bits_to_write;
+    hand_out_buffer(buffer, size);
+    m_eight_bytes = replacement;
+    m_capacity = replacement_size;
+    for(; i < m_capacity; i++) {
+        m_eight_bytes[i] = 0ull;
+    }
+    m_pointer = 0;
+    m_size = 0;
 }
 
-void Bitstream64::flush(UINT64* &buffer, UINT64 &size, UINT64 new_capacity) {
-    buffer = m_eight_bytes;
-    size = m_capacity;
-    m_eight_bytes = new UINT64[new_capacity];
-    m_capacity = new_capacity;
+void Bitstream64::return_buffer(UINT64* buffer, UINT64 size) {
+    if (m_free_count == EZB_FREE_LIST_SLOTS) { // free list is full, release the buffer
+        release_words(buffer, size, m_options);
+        return;
+    }
+    m_free_buffers[m_free_count] = buffer;
+    m_free_sizes[m_free_count] = size;
+    m_free_count++;
+}
+
+void Bitstream64::flush_trimmed(UINT64* &buffer, UINT64 &size, UINT64 &words_used, UINT64 &bits_used, UINT64 new_capacity) {
+    bits_used = m_size;
+    words_used = (m_size + 63) >> 6;
+    flush(buffer, size, new_capacity);
 }
 
 void Bitstream64::increment_pointer(UINT64 increment) {
@@ -442,16 +660,194 @@ UINT64 Bitstream64::capacity() {
     return m_capacity;
 }
 
+UINT64 Bitstream64::size_bits() {
+    return m_size;
+}
+
+BitstreamStats Bitstream64::stats() {
+#ifdef EZB_ENABLE_STATS
+    return m_stats;
+#else
+    return BitstreamStats();
+#endif
+}
+
+AllocationOptions Bitstream64::allocation_options() {
+    return m_options;
+}
+
 void Bitstream64::double_capacity() {
-    UINT64* old_buffer = m_eight_bytes;
-    m_eight_bytes = new UINT64[m_capacity << 1];
-    UINT64 i = 0;
-    for(; i < m_capacity; i++) {
-        m_eight_bytes[i] = old_buffer[i];
-    }
-    for(; i < (m_capacity << 1); i++) {
-        m_eight_bytes[i] = 0;
+    if (m_eight_bytes == m_inline) {
+        m_eight_bytes = allocate_words<UINT64>(m_capacity << 1, m_options);
+        for(UINT64 i = 0; i < m_capacity; i++) {
+            m_eight_bytes[i] = m_inline[i];
+        }
+    } else { // the allocator preserves the contents and zeroes the new half
+        m_eight_bytes = reallocate_words(m_eight_bytes, m_capacity, m_capacity << 1, m_options);
     }
-    delete[] old_buffer;
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::reallocations, 1));
+    EZB_STAT(stats::add(m_stats, &BitstreamStats::bytes_copied, m_capacity * sizeof(UINT64)));
     m_capacity <<= 1;
-}
\ No newline at end of file
+    EZB_STAT(stats::peak(m_stats, m_capacity * sizeof(UINT64)));
+}
+
+void Bitstream64::copy_bits(UINT64 start, UINT64 no_bits, UINT64 *out) {
+    UINT64 word_idx = start >> 6;
+    UINT64 shift = start & 0b111111ull;
+    UINT64 no_words = (no_bits + 63) >> 6;
+    for (UINT64 i = 0; i < no_words; i++) {
+        UINT64 word = m_eight_bytes[word_idx + i] >> shift;
+        if (shift && (i << 6) + 64 - shift < no_bits) { // the rest of the word comes from the next one
+            word |= m_eight_bytes[word_idx + i + 1] << (64 - shift);
+        }
+        out[i] = word;
+    }
+    if (no_bits & 0b111111ull) {
+        out[no_words - 1] &= MASK_SHIFT_64_RIGHT[64 - (no_bits & 0b111111ull)];
+    }
+}
+
+UINT32 Bitstream64::range_crc32c(UINT64 start, UINT64 no_bits) {
+    UINT64 chunk[256];
+    if (!(start & 0b111ull)) { // byte aligned, checksum the bytes in place
+        UINT32 crc = ezb::crc32c(reinterpret_cast<UINT8 *>(m_eight_bytes) + (start >> 3), no_bits >> 3);
+        if (no_bits & 0b111ull) {
+            copy_bits(start + (no_bits & ~0b111ull), no_bits & 0b111ull, chunk);
+            crc = ezb::crc32c(chunk, 1, crc);
+        }
+        return crc;
+    }
+    UINT32 crc = 0;
+    for (UINT64 done = 0; done < no_bits; done += 256 << 6) { // shift one chunk at a time into L1
+        UINT64 bits = no_bits - done < (256 << 6) ? no_bits - done : (256 << 6);
+        copy_bits(start + done, bits, chunk);
+        crc = ezb::crc32c(chunk, (bits + 7) >> 3, crc);
+    }
+    return crc;
+}
+
+UINT64* Bitstream64::acquire_buffer(UINT64 min_size, UINT64 &size) {
+    UINT64 slot = 0;
+    while(slot < m_free_count && m_free_sizes[slot] < min_size) {
+        slot++;
+    }
+    if (slot < m_free_count) { // reuse a returned buffer that is large enough, it has to be cleared first
+        UINT64* buffer = m_free_buffers[slot];
+        size = m_free_sizes[slot];
+        m_free_count--;
+        m_free_buffers[slot] = m_free_buffers[m_free_count];
+        m_free_sizes[slot] = m_free_sizes[m_free_count];
+        for(UINT64 i = 0; i < size; i++) {
+            buffer[i] = 0ull;
+        }
+        return buffer;
+    }
+    size = min_size;
+    return allocate_words<UINT64>(min_size, m_options);
+}
+
+void Bitstream64::hand_out_buffer(UINT64* &buffer, UINT64 &size) {
+    if (m_eight_bytes != m_inline) {
+        buffer = m_eight_bytes;
+        size = m_capacity;
+        return;
+    }
+    buffer = acquire_buffer(m_capacity, size);
+    for(UINT64 i = 0; i < m_capacity; i++) {
+        buffer[i] = m_eight_bytes[i];
+    }
+}
+
+template<typename Source>
+void Bitstream64::write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) { // reading from unallocated memory
+        return;
+    }
+    while(start_destination + no_bits_to_write > (m_capacity << 6)) {
+        double_capacity();
+    }
+    m_size = start_destination + no_bits_to_write > m_size ? start_destination + no_bits_to_write : m_size;
+    // the source is viewed once the destination has grown, as it may be the destination itself
+    copy_bit_range(reinterpret_cast<UINT8 *>(m_eight_bytes), start_destination, source.template as<UINT8>().words(),
+                   start_source, no_bits_to_write);
+}
+
+template<typename Source>
+void Bitstream64::write_stream(UINT64 start_source, UINT64 no_bits_to_write, Source &source) {
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+}
+
+template<typename Source>
+void Bitstream64::write_stream(UINT64 no_bits_to_write, Source &source) {
+    UINT64 start_source = source.pointer();
+    if(start_source + no_bits_to_write > (source.template as<UINT8>().no_words() << 3)) {
+        return;
+    }
+    write_stream(m_pointer, start_source, no_bits_to_write, source);
+    m_pointer += no_bits_to_write;
+    source.increment_pointer(no_bits_to_write);
+}
+
+template<typename T>
+WordView<T> Bitstream64::as() {
+    while((m_capacity * sizeof(UINT64)) % sizeof(T)) { // pad the buffer to whole words of the view
+        double_capacity();
+    }
+    return WordView<T>(reinterpret_cast<T *>(m_eight_bytes), m_capacity * sizeof(UINT64) / sizeof(T), m_size);
+}
+
+template<typename Source>
+bool Bitstream64::take(Source &source) {
+    if (!buffer_transferable(source)) {
+        return false;
+    }
+    UINT64 pointer = source.pointer();
+    UINT64 no_bits = source.size_bits();
+    typename Source::Word *buffer;
+    UINT64 size;
+    source.flush(buffer, size, 1);
+    UINT64 no_bytes = size * sizeof(typename Source::Word);
+    UINT64 padded_bytes = (no_bytes + sizeof(UINT64) - 1) & ~(sizeof(UINT64) - 1);
+    UINT8 *bytes = reinterpret_cast<UINT8 *>(buffer);
+    if (padded_bytes != no_bytes) { // the tail of the last word is zeroed by the allocator
+        bytes = reallocate_words(bytes, no_bytes, padded_bytes);
+    }
+    if (m_eight_bytes != m_inline) {
+        release_words(m_eight_bytes, m_capacity, m_options);
+    }
+    if (m_options.huge_pages == HUGE_PAGES_2MB || m_options.huge_pages == HUGE_PAGES_1GB) {
+        // the buffers kept for reuse are on explicit huge pages, release them before the options change
+        for(UINT64 i = 0; i < m_free_count; i++) {
+            release_words(m_free_buffers[i], m_free_sizes[i], m_options);
+        }
+        m_free_count = 0;
+        m_options.huge_pages = HUGE_PAGES_TRANSPARENT;
+    }
+    m_eight_bytes = reinterpret_cast<UINT64 *>(bytes);
+    m_capacity = padded_bytes / sizeof(UINT64);
+    m_size = no_bits;
+    m_pointer = pointer;
+    return true;
+}
+
+// the supported instantiations, the interop members are defined here rather than in the header
+template WordView<UINT8> Bitstream64::as<UINT8>();
+template WordView<UINT16> Bitstream64::as<UINT16>();
+template WordView<UINT32> Bitstream64::as<UINT32>();
+template WordView<UINT64> Bitstream64::as<UINT64>();
+template void Bitstream64::write_stream<Bitstream8>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream64::write_stream<Bitstream8>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream8 &source);
+template void Bitstream64::write_stream<Bitstream8>(UINT64 no_bits_to_write, Bitstream8 &source);
+template bool Bitstream64::take<Bitstream8>(Bitstream8 &source);
+template void Bitstream64::write_stream<Bitstream16>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source);
+template void Bitstream64::write_stream<Bitstream16>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream16 &source);
+template void Bitstream64::write_stream<Bitstream16>(UINT64 no_bits_to_write, Bitstream16 &source);
+template bool Bitstream64::take<Bitstream16>(Bitstream16 &source);
+template void Bitstream64::write_stream<Bitstream32>(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source);
+template void Bitstream64::write_stream<Bitstream32>(UINT64 start_source, UINT64 no_bits_to_write, Bitstream32 &source);
+template void Bitstream64::write_stream<Bitstream32>(UINT64 no_bits_to_write, Bitstream32 &source);
+template bool Bitstream64::take<Bitstream32>(Bitstream32 &source);
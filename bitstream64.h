@@ -2,6 +2,12 @@
 #define EZBITSTREAM_BITSTREAM64_H
 #include "ezbitstream.h"
 #include "tables.h"
+#include "stats.h"
+#include "allocator.h"
+#include "word_view.h"
+#include "morton.h"
+#include "checksum.h"
+#include "bit_ops.h"
 namespace ezb {
     /**
      * Defines a bitstream with word size of 8 bytes
@@ -11,10 +17,23 @@ namespace ezb {
      */
     class Bitstream64 {
     public:
+        typedef UINT64 Word; // type of the words of the buffer
+
         /**
          * Constructs a 0-based indexed bitstream of initial maximum capacity 64
+         * Streams of up to EZB_INLINE_BITS bits are kept in a buffer inside the object and do not allocate on the heap
+         * until they grow past it
          */
         Bitstream64(UINT64 no_bits = 64);
+
+        /**
+         * Constructs a 0-based indexed bitstream of initial maximum capacity no_bits whose buffer, once it is large
+         * enough to be mapped, is placed according to options (huge pages, NUMA policy, parallel first touch). The
+         * options apply to every later growth of the buffer as well
+         * @param no_bits Initial capacity of the bitstream in bits
+         * @param options Placement of the buffer of the bitstream
+         */
+        Bitstream64(UINT64 no_bits, const AllocationOptions &options);
         ~Bitstream64();
         Bitstream64(const Bitstream64 &other);
         Bitstream64 operator=(const Bitstream64 &other);
@@ -77,6 +96,25 @@ namespace ezb {
          */
         void write_word(UINT64 data, UINT8 no_bits_to_write = 64);
 
+        /**
+         * Variants of read_word and write_word for a width Bits known at compile time, defined inline below. The masks
+         * are constants and the split on two words is only tested for when Bits can straddle them: Bits = 1 is a
+         * single bit test or update, and Bits = 64 an aligned access or a funnel of two words. consume_word<Bits>() reads
+         * at the pointer of the stream and advances it, which read_word(UINT8) does not
+         * @param Bits Number of bits to be read or written, between 1 and 64
+         */
+        template<UINT8 Bits>
+        UINT64 read_word(UINT64 start);
+
+        template<UINT8 Bits>
+        UINT64 consume_word();
+
+        template<UINT8 Bits>
+        void write_word(UINT64 start, UINT64 data);
+
+        template<UINT8 Bits>
+        void write_word(UINT64 data);
+
         // buffer level operations
         /**
          * Writes no_bits_to_write bits from the buffer pointed to with data to the bitstream starting from the index
@@ -126,14 +164,210 @@ namespace ezb {
          */
         void write_stream(UINT64 no_bits_to_write, Bitstream64 &source);
 
+        /**
+         * Cross-width variants of the three write_stream functions above, for a source of another word width. The
+         * bits are copied 64 at a time between the byte images of the buffers, see word_view.h; the functions above
+         * copy the same way. When source is this stream, the two ranges must not overlap
+         * @param source Bitstream8, Bitstream16, Bitstream32 or Bitstream64
+         */
+        template<typename Source>
+        void write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Source &source);
+
+        template<typename Source>
+        void write_stream(UINT64 start_source, UINT64 no_bits_to_write, Source &source);
+
+        template<typename Source>
+        void write_stream(UINT64 no_bits_to_write, Source &source);
+
+        // interop with the other word widths
+        /**
+         * Returns a view of the buffer of the stream as words of type T, one of UINT8, UINT16, UINT32 or UINT64,
+         * without copying. The capacity is first doubled until the buffer holds a whole number of words of type T
+         */
+        template<typename T>
+        WordView<T> as();
+
+        /**
+         * Replaces the contents of the stream with those of source, a stream of another word width, taking over its
+         * buffer without copying. The buffer is padded with 0s to a whole number of words of this stream. The size and
+         * the pointer of the source carry over, and the source is left empty as after flush. The stream keeps its
+         * allocation options, except that explicit huge pages turn into transparent ones, as the buffer taken over
+         * is on regular pages
+         * @param source Bitstream8, Bitstream16, Bitstream32 or Bitstream64 other than this class
+         * @return False, leaving both streams unchanged, if the buffer of source can not be handed over, see
+         * buffer_transferable
+         */
+        template<typename Source>
+        bool take(Source &source);
+
+        /**
+         * Writes the lower bits_per_value bits of each of the no_values values back to back at the pointer of the
+         * stream and advances the pointer, growing the capacity once for all of them
+         * @param values Values to be written
+         * @param no_values Number of values
+         * @param bits_per_value Number of bits written per value, can not be more than 64
+         */
+        void write_packed(const UINT64 *values, UINT64 no_values, UINT8 bits_per_value);
+
+        /**
+         * Reads no_values values of bits_per_value bits each, stored back to back from the pointer of the stream, and
+         * advances the pointer
+         * @param values Buffer receiving the values, padded with 0s
+         * @param no_values Number of values
+         * @param bits_per_value Number of bits per value, can not be more than 64
+         */
+        void read_packed(UINT64 *values, UINT64 no_values, UINT8 bits_per_value);
+
+        /**
+         * Writes the lower widths[i] bits of each values[i] back to back at the pointer of the stream and advances the
+         * pointer, growing the capacity once for the total width
+         * @param values Values to be written
+         * @param widths Number of bits written per value, each between 1 and 64
+         * @param no_values Number of values
+         */
+        void write_fields(const UINT64 *values, const UINT8 *widths, UINT64 no_values);
+
+        /**
+         * Reads no_values values of widths[i] bits each, stored back to back from the pointer of the stream, and
+         * advances the pointer
+         * @param values Buffer receiving the values, padded with 0s
+         * @param widths Number of bits per value, each between 1 and 64
+         * @param no_values Number of values
+         */
+        void read_fields(UINT64 *values, const UINT8 *widths, UINT64 no_values);
+
+        // batch operations at random offsets
+        /**
+         * Reads width bits at each of the no_offsets offsets, as read_word(offsets[i], width) would, prefetching the
+         * words EZB_PREFETCH_DISTANCE offsets ahead so that the cache misses of consecutive reads overlap. Does not
+         * advance the pointer
+         * @param offsets Indices from which the reads start
+         * @param width Number of bits per read, between 1 and 64
+         * @param out Buffer of no_offsets words receiving the reads, padded with 0s
+         * @param no_offsets Number of offsets
+         */
+        void read_words(const UINT64 *offsets, UINT8 width, UINT64 *out, UINT64 no_offsets);
+
+        /**
+         * Writes the lower width bits of values[i] at each offsets[i] in order, as write_word(offsets[i], values[i],
+         * width) would, growing the capacity once and prefetching ahead as read_words. Does not advance the pointer
+         * @param offsets Indices from which the writes start
+         * @param values Values to be written
+         * @param width Number of bits per write, between 1 and 64
+         * @param no_offsets Number of offsets
+         */
+        void write_words(const UINT64 *offsets, const UINT64 *values, UINT8 width, UINT64 no_offsets);
+
+        /**
+         * Sets the bits at the no_indices indices to 1, prefetching ahead as read_words. Consecutive indices falling
+         * in the same word, as in sorted or clustered input, are merged into a single update of the word. As for
+         * set_bit, every index must be within the capacity of the stream
+         * @param indices Indices of the bits to be set, in any order
+         * @param no_indices Number of indices
+         */
+        void set_bits(const UINT64 *indices, UINT64 no_indices);
+
+        /**
+         * Copies the bits [start, start + no_bits) to out, shifted to start at bit 0. Does not advance the pointer
+         * @param start Index of the first bit
+         * @param no_bits Number of bits, start + no_bits can not be more than the capacity in bits
+         * @param out Buffer of at least ceil(no_bits / 64) words, bits of the last word past no_bits are set to 0
+         */
+        void copy_bits(UINT64 start, UINT64 no_bits, UINT64 *out);
+
+        // checksum operations
+        /**
+         * Returns the CRC-32C of the bits [start, start + no_bits), taken as the bytes they would occupy starting at bit
+         * 0 of a buffer, the last byte padded with 0s. Byte aligned ranges are checksummed in place, others through
+         * shifted copies of one L1-sized chunk at a time
+         * @param start Index of the first bit
+         * @param no_bits Number of bits, start + no_bits can not be more than the capacity in bits
+         * @param no_threads If more than 1, large ranges are split in as many chunks checksummed in parallel
+         */
+        UINT32 crc32c(UINT64 start, UINT64 no_bits, UINT32 no_threads = 1);
+
+        /**
+         * Returns the 64-bit XXH64 hash of the bits [start, start + no_bits), taken as bytes as in crc32c
+         */
+        UINT64 hash64(UINT64 start, UINT64 no_bits, UINT64 seed = 0);
+
+        // morton code operations
+        /**
+         * Writes the 2D Morton code of the lower bits_per_dim bits of x and y, 2 * bits_per_dim bits in total, at the
+         * pointer of the stream and advances the pointer. See morton.h for the bit order
+         * @param bits_per_dim Number of bits of each coordinate, can not be more than 32
+         */
+        void write_morton2(UINT32 x, UINT32 y, UINT8 bits_per_dim);
+
+        /**
+         * Writes the 3D Morton code of the lower bits_per_dim bits of x, y and z at the pointer of the stream and
+         * advances the pointer
+         * @param bits_per_dim Number of bits of each coordinate, can not be more than 21
+         */
+        void write_morton3(UINT32 x, UINT32 y, UINT32 z, UINT8 bits_per_dim);
+
+        /**
+         * Reads a 2D Morton code of 2 * bits_per_dim bits at the pointer of the stream into x and y and advances the
+         * pointer
+         */
+        void read_morton2(UINT32 &x, UINT32 &y, UINT8 bits_per_dim);
+
+        /**
+         * Reads a 3D Morton code of 3 * bits_per_dim bits at the pointer of the stream into x, y and z and advances the
+         * pointer
+         */
+        void read_morton3(UINT32 &x, UINT32 &y, UINT32 &z, UINT8 bits_per_dim);
+
+        /**
+         * Batch variants writing or reading the Morton codes of no_keys coordinates back to back. The capacity is grown
+         * once for the whole batch
+         */
+        void write_morton2(const UINT32 *x, const UINT32 *y, UINT64 no_keys, UINT8 bits_per_dim);
+        void write_morton3(const UINT32 *x, const UINT32 *y, const UINT32 *z, UINT64 no_keys, UINT8 bits_per_dim);
+        void read_morton2(UINT32 *x, UINT32 *y, UINT64 no_keys, UINT8 bits_per_dim);
+        void read_morton3(UINT32 *x, UINT32 *y, UINT32 *z, UINT64 no_keys, UINT8 bits_per_dim);
+
         /**
          * Returns a reference to the buffer of the bitstream and the size of the buffer in words. Allocates a new
-         * buffer for the bitstream object. Return values are through the parameter list
+         * buffer for the bitstream object and resets the pointer and the size of the stream. Return values are through
+         * the parameter list. The caller owns the returned buffer and releases it with release_words(buffer, size) or
+         * hands it back through return_buffer. Streams constructed with allocation options release their buffers with
+         * release_words(buffer, size, options)
          * @param buffer Reference to the buffer of the bitstream
          * @param size Size of the buffer of the bitstream
          */
         void flush(UINT64 *&buffer, UINT64 &size, UINT64 new_capacity=64);
 
+        /**
+         * Same as flush, but reports only the part of the buffer that was written to instead of its capacity. Bits of
+         * the last word past bits_used are zero padding
+         * @param buffer Reference to the buffer of the bitstream
+         * @param size Size of the buffer of the bitstream, needed to release the buffer
+         * @param words_used Number of words of the buffer holding the written bits, ceil(bits_used / 64)
+         * @param bits_used Number of bits written to the stream, see size_bits
+         * @param new_capacity Capacity of the new buffer of the bitstream in words
+         */
+        void flush_trimmed(UINT64 *&buffer, UINT64 &size, UINT64 &words_used, UINT64 &bits_used, UINT64 new_capacity=64);
+
+        /**
+         * Same as flush, but instead of allocating a new buffer the bitstream takes over the buffer given by the
+         * caller, which is zeroed before use. The buffer must have been allocated with allocate_words. A stream that still fits
+         * its inline buffer keeps it and hands its contents out in the replacement buffer instead
+         * @param buffer Reference to the buffer of the bitstream
+         * @param size Size of the buffer of the bitstream
+         * @param replacement Buffer the bitstream continues with
+         * @param replacement_size Size of the replacement buffer in words, can not be 0
+         */
+        void flush(UINT64 *&buffer, UINT64 &size, UINT64 *replacement, UINT64 replacement_size);
+
+        /**
+         * Hands a buffer obtained through flush back to the bitstream. Up to EZB_FREE_LIST_SLOTS returned buffers are
+         * kept and reused by subsequent flushes instead of allocating, any further buffer is released
+         * @param buffer Buffer previously returned by flush
+         * @param size Size of the buffer in words
+         */
+        void return_buffer(UINT64 *buffer, UINT64 size);
+
         //pointer operations
         /**
          * Increments the pointer of the stream denoted by increment with maximum value clamped to bit capacity
@@ -164,15 +398,106 @@ namespace ezb {
          */
         UINT64 capacity();
 
+        /**
+         * Returns the logical size of the stream: one past the index of the furthest bit ever written, independent of
+         * the pointer and of the capacity of the buffer
+         */
+        UINT64 size_bits();
+
+        /**
+         * Returns the operation counters of the bitstream, all zero unless compiled with EZB_ENABLE_STATS
+         */
+        BitstreamStats stats();
+
+        /**
+         * Returns the allocation options the buffer of the stream is placed with
+         */
+        AllocationOptions allocation_options();
+
     private:
+        static const UINT64 INLINE_WORDS = EZB_INLINE_BITS >> 6;
+
         /**
          * Doubles the capacity of the buffer in case no_bits_to_write > (m_capacity)
          */
         void double_capacity();
 
+        /**
+         * Single threaded crc32c over a bit range, only reads the buffer
+         */
+        UINT32 range_crc32c(UINT64 start, UINT64 no_bits);
+
+        /**
+         * Returns a buffer of at least min_size words, taken from the free list if possible
+         * @param min_size Minimum size of the buffer in words
+         * @param size Actual size of the returned buffer in words
+         */
+        UINT64 *acquire_buffer(UINT64 min_size, UINT64 &size);
+
+        /**
+         * Returns the buffer of the stream for a flush; the inline buffer stays with the stream, so its contents are
+         * handed out in a copy
+         */
+        void hand_out_buffer(UINT64 *&buffer, UINT64 &size);
+
         UINT64 m_pointer;
+        UINT64 m_size;
         UINT64 *m_eight_bytes;
         UINT64 m_capacity;
+        UINT64 *m_free_buffers[EZB_FREE_LIST_SLOTS];
+        UINT64 m_free_sizes[EZB_FREE_LIST_SLOTS];
+        UINT64 m_free_count;
+        AllocationOptions m_options;
+        UINT64 m_inline[INLINE_WORDS];
+#ifdef EZB_ENABLE_STATS
+        BitstreamStats m_stats;
+#endif
     };
+
+    template<UINT8 Bits>
+    inline UINT64 Bitstream64::read_word(UINT64 start) {
+        static_assert(Bits >= 1 && Bits <= 64, "words are 1 to 64 bits wide");
+        UINT64 word_idx = start >> 6;
+        UINT64 bit_offset = start & 0b111111ull;
+        UINT64 word = m_eight_bytes[word_idx] >> bit_offset;
+        if (Bits > 1 && bit_offset + Bits > 64) { // the read is split on two words
+            EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
+            word |= m_eight_bytes[word_idx + 1] << (64 - bit_offset);
+        }
+        return word & (~0ull >> (64 - Bits));
+    }
+
+    template<UINT8 Bits>
+    inline UINT64 Bitstream64::consume_word() {
+        UINT64 word = read_word<Bits>(m_pointer);
+        m_pointer += Bits;
+        return word;
+    }
+
+    template<UINT8 Bits>
+    inline void Bitstream64::write_word(UINT64 start, UINT64 data) {
+        static_assert(Bits >= 1 && Bits <= 64, "words are 1 to 64 bits wide");
+        const UINT64 mask = ~0ull >> (64 - Bits);
+        while(start + Bits > (m_capacity << 6)) {
+            double_capacity();
+        }
+        m_size = start + Bits > m_size ? start + Bits : m_size;
+        UINT64 word_idx = start >> 6;
+        UINT64 bit_offset = start & 0b111111ull;
+        EZB_STAT(stats::add(m_stats, bit_offset ? &BitstreamStats::unaligned_writes : &BitstreamStats::aligned_writes, 1));
+        data &= mask;
+        m_eight_bytes[word_idx] = (m_eight_bytes[word_idx] & ~(mask << bit_offset)) | (data << bit_offset);
+        if (Bits > 1 && bit_offset + Bits > 64) { // the write is split on two words
+            EZB_STAT(stats::add(m_stats, &BitstreamStats::split_word_accesses, 1));
+            m_eight_bytes[word_idx + 1] = (m_eight_bytes[word_idx + 1] & ~(mask >> (64 - bit_offset))) |
+                                          (data >> (64 - bit_offset));
+        }
+    }
+
+    template<UINT8 Bits>
+    inline void Bitstream64::write_word(UINT64 data) {
+        write_word<Bits>(m_pointer, data);
+        m_pointer += Bits;
+    }
 }
 #endif //EZBITSTREAM_BITSTREAM64_H
@@ -2,6 +2,9 @@
 #define EZBITSTREAM_BITSTREAM8_H
 #include "ezbitstream.h"
 #include "tables.h"
+#include "stats.h"
+#include "allocator.h"
+#include "word_view.h"
 namespace ezb {
     /**
      * Defines a bitstream with word size of one byte
@@ -11,8 +14,12 @@ namespace ezb {
      */
     class Bitstream8 {
     public:
+        typedef UINT8 Word; // type of the words of the buffer
+
         /**
          * Constructs a 0-based indexed bitstream of initial maximum capacity 64
+         * Streams of up to EZB_INLINE_BITS bits are kept in a buffer inside the object and do not allocate on the heap
+         * until they grow past it
          * By default, the bitstream is resizable, but can be made to be a custom constant-sized buffer
          */
         Bitstream8(UINT64 no_bits = 64);
@@ -127,14 +134,80 @@ namespace ezb {
          */
         void write_stream(UINT64 no_bits_to_write, Bitstream8 &source);
 
+        /**
+         * Cross-width variants of the three write_stream functions above, for a source of another word width. The
+         * bits are copied 64 at a time between the byte images of the buffers, see word_view.h; the functions above
+         * copy the same way. When source is this stream, the two ranges must not overlap
+         * @param source Bitstream8, Bitstream16, Bitstream32 or Bitstream64
+         */
+        template<typename Source>
+        void write_stream(UINT64 start_destination, UINT64 start_source, UINT64 no_bits_to_write, Source &source);
+
+        template<typename Source>
+        void write_stream(UINT64 start_source, UINT64 no_bits_to_write, Source &source);
+
+        template<typename Source>
+        void write_stream(UINT64 no_bits_to_write, Source &source);
+
+        // interop with the other word widths
+        /**
+         * Returns a view of the buffer of the stream as words of type T, one of UINT8, UINT16, UINT32 or UINT64,
+         * without copying. The capacity is first doubled until the buffer holds a whole number of words of type T
+         */
+        template<typename T>
+        WordView<T> as();
+
+        /**
+         * Replaces the contents of the stream with those of source, a stream of another word width, taking over its
+         * buffer without copying. The buffer is padded with 0s to a whole number of words of this stream. The size and
+         * the pointer of the source carry over, and the source is left empty as after flush
+         * @param source Bitstream8, Bitstream16, Bitstream32 or Bitstream64 other than this class
+         * @return False, leaving both streams unchanged, if the buffer of source can not be handed over, see
+         * buffer_transferable
+         */
+        template<typename Source>
+        bool take(Source &source);
+
         /**
          * Returns a reference to the buffer of the bitstream and the size of the buffer in words. Allocates a new
-         * buffer for the bitstream object. Return values are through the parameter list
+         * buffer for the bitstream object and resets the pointer and the size of the stream. Return values are through
+         * the parameter list. The caller owns the returned buffer and releases it with release_words(buffer, size) or
+         * hands it back through return_buffer
          * @param buffer Reference to the buffer of the bitstream
          * @param size Size of the buffer of the bitstream
          */
         void flush(UINT8 *&buffer, UINT64 &size, UINT64 new_capacity=64);
 
+        /**
+         * Same as flush, but reports only the part of the buffer that was written to instead of its capacity. Bits of
+         * the last word past bits_used are zero padding
+         * @param buffer Reference to the buffer of the bitstream
+         * @param size Size of the buffer of the bitstream, needed to release the buffer
+         * @param words_used Number of words of the buffer holding the written bits, ceil(bits_used / 8)
+         * @param bits_used Number of bits written to the stream, see size_bits
+         * @param new_capacity Capacity of the new buffer of the bitstream in words
+         */
+        void flush_trimmed(UINT8 *&buffer, UINT64 &size, UINT64 &words_used, UINT64 &bits_used, UINT64 new_capacity=64);
+
+        /**
+         * Same as flush, but instead of allocating a new buffer the bitstream takes over the buffer given by the
+         * caller, which is zeroed before use. The buffer must have been allocated with allocate_words. A stream that still fits
+         * its inline buffer keeps it and hands its contents out in the replacement buffer instead
+         * @param buffer Reference to the buffer of the bitstream
+         * @param size Size of the buffer of the bitstream
+         * @param replacement Buffer the bitstream continues with
+         * @param replacement_size Size of the replacement buffer in words, can not be 0
+         */
+        void flush(UINT8 *&buffer, UINT64 &size, UINT8 *replacement, UINT64 replacement_size);
+
+        /**
+         * Hands a buffer obtained through flush back to the bitstream. Up to EZB_FREE_LIST_SLOTS returned buffers are
+         * kept and reused by subsequent flushes instead of allocating, any further buffer is released
+         * @param buffer Buffer previously returned by flush
+         * @param size Size of the buffer in words
+         */
+        void return_buffer(UINT8 *buffer, UINT64 size);
+
         //pointer operations
         /**
          * Increments the pointer of the stream denoted by increment with maximum value clamped to bit capacity
@@ -165,15 +238,49 @@ namespace ezb {
           */
           UINT64 capacity();
 
+        /**
+         * Returns the logical size of the stream: one past the index of the furthest bit ever written, independent of
+         * the pointer and of the capacity of the buffer
+         */
+        UINT64 size_bits();
+
+        /**
+         * Returns the operation counters of the bitstream, all zero unless compiled with EZB_ENABLE_STATS
+         */
+        BitstreamStats stats();
+
     private:
+        static const UINT64 INLINE_WORDS = EZB_INLINE_BITS >> 3;
+
         /**
          * Doubles the capacity of the buffer in case no_bits_to_write > (m_capacity)
          */
         void double_capacity();
 
+        /**
+         * Returns a buffer of at least min_size words, taken from the free list if possible
+         * @param min_size Minimum size of the buffer in words
+         * @param size Actual size of the returned buffer in words
+         */
+        UINT8 *acquire_buffer(UINT64 min_size, UINT64 &size);
+
+        /**
+         * Returns the buffer of the stream for a flush; the inline buffer stays with the stream, so its contents are
+         * handed out in a copy
+         */
+        void hand_out_buffer(UINT8 *&buffer, UINT64 &size);
+
         UINT64 m_pointer;
+        UINT64 m_size;
         UINT8  *m_bytes;
         UINT64 m_capacity;
+        UINT8 *m_free_buffers[EZB_FREE_LIST_SLOTS];
+        UINT64 m_free_sizes[EZB_FREE_LIST_SLOTS];
+        UINT64 m_free_count;
+        alignas(8) UINT8 m_inline[INLINE_WORDS]; // aligned for views as wider words
+#ifdef EZB_ENABLE_STATS
+        BitstreamStats m_stats;
+#endif
     };
 }
 #endif //EZBITSTREAM_BITSTREAM8_H
@@ -0,0 +1,249 @@
+#include "checksum.h"
+#include <thread>
+#include <vector>
+#include <string.h>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+using namespace ezb;
+
+namespace {
+    const UINT32 CRC32C_POLY = 0x82F63B78u; // reflected Castagnoli polynomial
+
+    /**
+     * Multiplies two polynomials modulo the CRC polynomial, in the reflected bit order of the CRC
+     */
+    UINT32 multiply_mod(UINT32 a, UINT32 b) {
+        UINT32 product = 0;
+        for (UINT32 m = 1u << 31; m; m >>= 1) {
+            if (a & m) {
+                product ^= b;
+            }
+            b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+        }
+        return product;
+    }
+
+    /**
+     * Returns x^(8 * no_bytes) modulo the CRC polynomial, the factor shifting a CRC state over no_bytes zero bytes
+     */
+    UINT32 shift_factor(UINT64 no_bytes) {
+        static const struct Powers { // powers[k] = x^(2^k)
+            UINT32 powers[64];
+            Powers() {
+                powers[0] = 1u << 30;
+                for (int k = 1; k < 64; k++) {
+                    powers[k] = multiply_mod(powers[k - 1], powers[k - 1]);
+                }
+            }
+        } table;
+        UINT32 factor = 1u << 31; // x^0
+        for (int k = 3; no_bytes; no_bytes >>= 1, k++) {
+            if (no_bytes & 1) {
+                factor = multiply_mod(table.powers[k], factor);
+            }
+        }
+        return factor;
+    }
+
+    /**
+     * Slicing-by-8 tables, tables[k][b] is the CRC state of byte b followed by k zero bytes
+     */
+    struct SliceTables {
+        UINT32 tables[8][256];
+        SliceTables() {
+            for (UINT32 b = 0; b < 256; b++) {
+                UINT32 crc = b;
+                for (int i = 0; i < 8; i++) {
+                    crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                }
+                tables[0][b] = crc;
+            }
+            for (UINT32 b = 0; b < 256; b++) {
+                for (int k = 1; k < 8; k++) {
+                    tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+                }
+            }
+        }
+    };
+
+    /**
+     * Advances the raw CRC state, without the initial and final inversions, over the buffer
+     */
+    UINT32 crc_state(UINT32 state, const UINT8 *data, UINT64 no_bytes) {
+#if defined(__SSE4_2__)
+        const UINT64 LANE_BYTES = 4096;
+        UINT64 state64 = state;
+        for (; no_bytes >= 3 * LANE_BYTES; no_bytes -= 3 * LANE_BYTES, data += 3 * LANE_BYTES) {
+            // three independent lanes hide the latency of the crc32 instruction, then the lanes are shifted together
+            static const UINT32 SHIFT_1 = shift_factor(LANE_BYTES), SHIFT_2 = shift_factor(2 * LANE_BYTES);
+            UINT64 lane_1 = 0, lane_2 = 0;
+            for (UINT64 i = 0; i < LANE_BYTES; i += 8) {
+                UINT64 w0, w1, w2;
+                memcpy(&w0, data + i, 8);
+                memcpy(&w1, data + LANE_BYTES + i, 8);
+                memcpy(&w2, data + 2 * LANE_BYTES + i, 8);
+                state64 = _mm_crc32_u64(state64, w0);
+                lane_1 = _mm_crc32_u64(lane_1, w1);
+                lane_2 = _mm_crc32_u64(lane_2, w2);
+            }
+            state64 = multiply_mod(SHIFT_2, (UINT32) state64) ^ multiply_mod(SHIFT_1, (UINT32) lane_1) ^ lane_2;
+        }
+        for (; no_bytes >= 8; no_bytes -= 8, data += 8) {
+            UINT64 word;
+            memcpy(&word, data, 8);
+            state64 = _mm_crc32_u64(state64, word);
+        }
+        state = (UINT32) state64;
+        for (; no_bytes; no_bytes--) {
+            state = _mm_crc32_u8(state, *data++);
+        }
+        return state;
+#else
+        static const SliceTables slices;
+        const UINT32 (*t)[256] = slices.tables;
+        for (; no_bytes >= 8; no_bytes -= 8, data += 8) {
+            UINT32 low = state ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((UINT32) data[3] << 24));
+            state = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                    t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        }
+        for (; no_bytes; no_bytes--) {
+            state = (state >> 8) ^ t[0][(state ^ *data++) & 0xFF];
+        }
+        return state;
+#endif
+    }
+
+    const UINT64 PRIME64_1 = 0x9E3779B185EBCA87ull;
+    const UINT64 PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+    const UINT64 PRIME64_3 = 0x165667B19E3779F9ull;
+    const UINT64 PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+    const UINT64 PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+    inline UINT64 rotate_left(UINT64 x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline UINT64 hash_round(UINT64 lane, UINT64 input) {
+        return rotate_left(lane + input * PRIME64_2, 31) * PRIME64_1;
+    }
+
+    inline UINT64 read64(const UINT8 *data) {
+        UINT64 word;
+        memcpy(&word, data, 8);
+        return word;
+    }
+
+    inline UINT32 read32(const UINT8 *data) {
+        UINT32 word;
+        memcpy(&word, data, 4);
+        return word;
+    }
+}
+
+UINT32 ezb::crc32c(const void *data, UINT64 no_bytes, UINT32 crc) {
+    return ~crc_state(~crc, static_cast<const UINT8 *>(data), no_bytes);
+}
+
+UINT32 ezb::crc32c_combine(UINT32 crc1, UINT32 crc2, UINT64 no_bytes2) {
+    return multiply_mod(shift_factor(no_bytes2), crc1) ^ crc2;
+}
+
+UINT32 ezb::crc32c_parallel(const void *data, UINT64 no_bytes, UINT32 no_threads, UINT32 crc) {
+    const UINT8 *bytes = static_cast<const UINT8 *>(data);
+    UINT64 chunk = no_threads > 1 ? (no_bytes / no_threads + 63) & ~63ull : no_bytes;
+    if (no_threads < 2 || chunk < (1ull << 16)) { // not worth the threads
+        return crc32c(data, no_bytes, crc);
+    }
+    std::vector<UINT32> crcs(no_threads, 0);
+    std::vector<std::thread> workers;
+    for (UINT32 t = 1; t < no_threads && t * chunk < no_bytes; t++) {
+        UINT64 size = no_bytes - t * chunk < chunk ? no_bytes - t * chunk : chunk;
+        workers.emplace_back([&crcs, bytes, t, chunk, size]() {
+            crcs[t] = crc32c(bytes + t * chunk, size);
+        });
+    }
+    crc = crc32c(bytes, chunk, crc);
+    for (UINT32 t = 1; t <= workers.size(); t++) {
+        workers[t - 1].join();
+        UINT64 size = no_bytes - t * chunk < chunk ? no_bytes - t * chunk : chunk;
+        crc = crc32c_combine(crc, crcs[t], size);
+    }
+    return crc;
+}
+
+Hash64::Hash64(UINT64 seed) {
+    m_seed = seed;
+    m_lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    m_lanes[1] = seed + PRIME64_2;
+    m_lanes[2] = seed;
+    m_lanes[3] = seed - PRIME64_1;
+    m_total = 0;
+    m_stripe_size = 0;
+}
+
+void Hash64::update(const void *data, UINT64 no_bytes) {
+    const UINT8 *bytes = static_cast<const UINT8 *>(data);
+    m_total += no_bytes;
+    if (m_stripe_size) { // complete the partial stripe first
+        UINT64 fill = 32 - m_stripe_size < no_bytes ? 32 - m_stripe_size : no_bytes;
+        memcpy(m_stripe + m_stripe_size, bytes, fill);
+        m_stripe_size += fill;
+        bytes += fill;
+        no_bytes -= fill;
+        if (m_stripe_size < 32) {
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            m_lanes[i] = hash_round(m_lanes[i], read64(m_stripe + 8 * i));
+        }
+        m_stripe_size = 0;
+    }
+    for (; no_bytes >= 32; no_bytes -= 32, bytes += 32) {
+        m_lanes[0] = hash_round(m_lanes[0], read64(bytes));
+        m_lanes[1] = hash_round(m_lanes[1], read64(bytes + 8));
+        m_lanes[2] = hash_round(m_lanes[2], read64(bytes + 16));
+        m_lanes[3] = hash_round(m_lanes[3], read64(bytes + 24));
+    }
+    memcpy(m_stripe, bytes, no_bytes);
+    m_stripe_size = no_bytes;
+}
+
+UINT64 Hash64::digest() {
+    UINT64 hash;
+    if (m_total >= 32) {
+        hash = rotate_left(m_lanes[0], 1) + rotate_left(m_lanes[1], 7) + rotate_left(m_lanes[2], 12) +
+               rotate_left(m_lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash = (hash ^ hash_round(0, m_lanes[i])) * PRIME64_1 + PRIME64_4;
+        }
+    } else {
+        hash = m_seed + PRIME64_5;
+    }
+    hash += m_total;
+    const UINT8 *tail = m_stripe;
+    UINT64 left = m_stripe_size;
+    for (; left >= 8; left -= 8, tail += 8) {
+        hash = rotate_left(hash ^ hash_round(0, read64(tail)), 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (left >= 4) {
+        hash = rotate_left(hash ^ (read32(tail) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        left -= 4;
+        tail += 4;
+    }
+    for (; left; left--) {
+        hash = rotate_left(hash ^ (*tail++ * PRIME64_5), 11) * PRIME64_1;
+    }
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    return hash ^ (hash >> 32);
+}
+
+UINT64 ezb::hash64(const void *data, UINT64 no_bytes, UINT64 seed) {
+    Hash64 hash(seed);
+    hash.update(data, no_bytes);
+    return hash.digest();
+}
@@ -0,0 +1,63 @@
+#ifndef EZBITSTREAM_CHECKSUM_H
+#define EZBITSTREAM_CHECKSUM_H
+#include "ezbitstream.h"
+
+/**
+ * Checksums and hashes over byte buffers. Bit ranges of a stream are checksummed through Bitstream64::crc32c and
+ * Bitstream64::hash64, which see the range as the bytes it would occupy if it started at bit 0 of a buffer.
+ */
+namespace ezb {
+    /**
+     * Returns the CRC-32C (Castagnoli) of the buffer, continuing from crc, the CRC of the preceding bytes or 0. Uses the
+     * SSE4.2 crc32 instruction on three interleaved lanes when compiled for SSE4.2, slicing-by-8 tables otherwise
+     * @param data Buffer to be checksummed
+     * @param no_bytes Size of the buffer in bytes
+     * @param crc CRC of the bytes preceding the buffer, 0 for none
+     */
+    UINT32 crc32c(const void *data, UINT64 no_bytes, UINT32 crc = 0);
+
+    /**
+     * Returns the CRC of the concatenation of two buffers given their CRCs, in time logarithmic in no_bytes2
+     * @param crc1 CRC of the first buffer
+     * @param crc2 CRC of the second buffer
+     * @param no_bytes2 Size of the second buffer in bytes
+     */
+    UINT32 crc32c_combine(UINT32 crc1, UINT32 crc2, UINT64 no_bytes2);
+
+    /**
+     * Computes crc32c(data, no_bytes, crc) with the buffer split in no_threads chunks checksummed in parallel
+     */
+    UINT32 crc32c_parallel(const void *data, UINT64 no_bytes, UINT32 no_threads, UINT32 crc = 0);
+
+    /**
+     * Streaming 64-bit non-cryptographic hash, computing XXH64: four multiply-rotate lanes over 32-byte stripes and a
+     * final avalanche. Results match the reference xxHash XXH64 for the same seed
+     */
+    class Hash64 {
+    public:
+        Hash64(UINT64 seed = 0);
+
+        /**
+         * Hashes no_bytes more bytes of data
+         */
+        void update(const void *data, UINT64 no_bytes);
+
+        /**
+         * Returns the hash of all the bytes given so far, the hash can keep being updated afterwards
+         */
+        UINT64 digest();
+
+    private:
+        UINT64 m_lanes[4];
+        UINT64 m_seed;
+        UINT64 m_total;
+        UINT8 m_stripe[32];     // bytes of a partial stripe
+        UINT64 m_stripe_size;
+    };
+
+    /**
+     * Returns the XXH64 hash of the buffer
+     */
+    UINT64 hash64(const void *data, UINT64 no_bytes, UINT64 seed = 0);
+}
+#endif //EZBITSTREAM_CHECKSUM_H
@@ -0,0 +1,405 @@
+#include "compressed.h"
+#include "allocator.h"
+#include "bit_ops.h"
+#include <string.h>
+#include <thread>
+#include <vector>
+using namespace ezb;
+
+namespace {
+    const char MAGIC[8] = {'E', 'Z', 'B', 'Z', 'B', 'L', 'K', 0};
+    const UINT64 MAX_BLOCK_WORDS = 1ull << 24;
+
+    enum BlockKind {
+        BLOCK_RAW = 0,
+        BLOCK_ZERO = 1,
+        BLOCK_CODEC = 2
+    };
+
+    struct CompressedHeader {
+        char magic[8];
+        UINT64 no_bits;
+        UINT64 no_blocks;
+        UINT32 block_words;
+        UINT8 codec_id;
+        UINT8 reserved[3];
+        UINT64 data_bytes;
+    };
+
+    static_assert(sizeof(CompressedHeader) == 40, "the compressed header is 40 bytes");
+
+    inline UINT64 align_word(UINT64 bytes) {
+        return (bytes + 7) & ~7ull;
+    }
+
+    UINT64 zero_run_bound(UINT64 no_words) {
+        return (((no_words + 63) >> 6) + no_words) << 3;
+    }
+
+    UINT64 zero_run_compress(const UINT64 *words, UINT64 no_words, UINT8 *out) {
+        UINT64 *output = reinterpret_cast<UINT64 *>(out);
+        UINT64 pos = 0;
+        for (UINT64 group = 0; group < no_words; group += 64) {
+            UINT64 end = group + 64 < no_words ? group + 64 : no_words;
+            UINT64 mask_pos = pos++;
+            UINT64 mask = 0;
+            for (UINT64 i = group; i < end; i++) { // store every word, keep it only if it is not zero
+                UINT64 nonzero = words[i] != 0;
+                output[pos] = words[i];
+                pos += nonzero;
+                mask |= nonzero << (i - group);
+            }
+            output[mask_pos] = mask;
+        }
+        return pos << 3;
+    }
+
+    bool zero_run_decompress(const UINT8 *in, UINT64 no_bytes, UINT64 *words, UINT64 no_words) {
+        const UINT64 *input = reinterpret_cast<const UINT64 *>(in);
+        UINT64 no_input = no_bytes >> 3;
+        UINT64 pos = 0;
+        memset(words, 0, no_words << 3);
+        for (UINT64 group = 0; group < no_words; group += 64) {
+            if (pos >= no_input) {
+                return false;
+            }
+            UINT64 mask = input[pos++];
+            UINT64 group_words = no_words - group < 64 ? no_words - group : 64;
+            if ((group_words < 64 && (mask >> group_words)) || popcount(mask) > no_input - pos) {
+                return false;
+            }
+            for (; mask; mask &= mask - 1) {
+                words[group + trailing_zeros(mask)] = input[pos++];
+            }
+        }
+        return pos == no_input && !(no_bytes & 0b111ull);
+    }
+}
+
+const BlockCodec ezb::ZERO_RUN_CODEC = {1, zero_run_bound, zero_run_compress, zero_run_decompress};
+
+CompressionOptions::CompressionOptions() {
+    block_words = 512;
+    codec = &ZERO_RUN_CODEC;
+    no_threads = 1;
+    cache_blocks = 8;
+}
+
+CompressedBitstream::CompressedBitstream() {
+    m_owned = nullptr;
+    m_owned_words = 0;
+    m_cache = nullptr;
+    m_cache_tags = nullptr;
+    m_cache_blocks = 0;
+    close();
+}
+
+CompressedBitstream::~CompressedBitstream() {
+    close();
+}
+
+void CompressedBitstream::compress(Bitstream64 &stream, const CompressionOptions &options) {
+    close();
+    if (options.block_words < 64 || options.block_words > MAX_BLOCK_WORDS ||
+        (options.block_words & (options.block_words - 1))) {
+        return;
+    }
+    UINT64 no_bits = stream.size_bits();
+    UINT64 no_words = (no_bits + 63) >> 6;
+    UINT64 block_words = options.block_words;
+    UINT64 no_blocks = (no_words + block_words - 1) / block_words;
+    const UINT64 *words = stream.as<UINT64>().words();
+    const BlockCodec *codec = options.codec;
+
+    std::vector<UINT64> sizes(no_blocks, 0);
+    std::vector<UINT8> kinds(no_blocks, BLOCK_RAW);
+    UINT64 no_threads = options.no_threads > 1 ? options.no_threads : 1;
+    no_threads = no_threads < no_blocks ? no_threads : (no_blocks ? no_blocks : 1);
+    std::vector<std::vector<UINT8>> outputs(no_threads);
+    auto work = [&](UINT64 thread) {
+        UINT64 first = no_blocks * thread / no_threads;
+        UINT64 last = no_blocks * (thread + 1) / no_threads;
+        std::vector<UINT64> tail(block_words);
+        std::vector<UINT8> compressed(codec->bound(block_words));
+        std::vector<UINT8> &output = outputs[thread];
+        for (UINT64 b = first; b < last; b++) {
+            UINT64 size = no_words - b * block_words < block_words ? no_words - b * block_words : block_words;
+            const UINT64 *block = words + b * block_words;
+            if (b + 1 == no_blocks && (no_bits & 0b111111ull)) { // clear the bits past the end of the stream
+                memcpy(tail.data(), block, size << 3);
+                tail[size - 1] &= MASK_SHIFT_64_RIGHT[64 - (no_bits & 0b111111ull)];
+                block = tail.data();
+            }
+            UINT64 any = 0;
+            for (UINT64 i = 0; i < size; i++) {
+                any |= block[i];
+            }
+            if (!any) {
+                kinds[b] = BLOCK_ZERO;
+                continue;
+            }
+            UINT64 compressed_bytes = codec->compress(block, size, compressed.data());
+            const UINT8 *source = reinterpret_cast<const UINT8 *>(block);
+            if (compressed_bytes < (size << 3)) {
+                kinds[b] = BLOCK_CODEC;
+                source = compressed.data();
+            } else {
+                compressed_bytes = size << 3;
+            }
+            sizes[b] = align_word(compressed_bytes);
+            output.insert(output.end(), source, source + compressed_bytes);
+            output.resize(output.size() + sizes[b] - compressed_bytes, 0);
+        }
+    };
+    if (no_threads > 1) {
+        std::vector<std::thread> workers;
+        for (UINT64 t = 1; t < no_threads; t++) {
+            workers.emplace_back(work, t);
+        }
+        work(0);
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    } else {
+        work(0);
+    }
+
+    UINT64 data_bytes = 0;
+    for (std::vector<UINT8> &output : outputs) {
+        data_bytes += output.size();
+    }
+    UINT64 tables_bytes = ((no_blocks + 1) << 3) + align_word(no_blocks);
+    UINT64 bytes = sizeof(CompressedHeader) + tables_bytes + data_bytes;
+    UINT64 owned_words = bytes >> 3;
+    UINT64 *owned = allocate_words<UINT64>(owned_words);
+    UINT8 *base = reinterpret_cast<UINT8 *>(owned);
+
+    CompressedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.no_bits = no_bits;
+    header.no_blocks = no_blocks;
+    header.block_words = (UINT32) block_words;
+    header.codec_id = codec->id;
+    header.data_bytes = data_bytes;
+    memcpy(base, &header, sizeof(header));
+    UINT64 *offsets = reinterpret_cast<UINT64 *>(base + sizeof(header));
+    UINT64 offset = 0;
+    for (UINT64 b = 0; b < no_blocks; b++) {
+        offsets[b] = offset;
+        offset += sizes[b];
+    }
+    offsets[no_blocks] = offset;
+    if (no_blocks) {
+        memcpy(base + sizeof(header) + ((no_blocks + 1) << 3), kinds.data(), no_blocks);
+    }
+    UINT8 *data = base + sizeof(header) + tables_bytes;
+    for (std::vector<UINT8> &output : outputs) {
+        if (!output.empty()) {
+            memcpy(data, output.data(), output.size());
+            data += output.size();
+        }
+    }
+    attach(owned, bytes, options);
+    m_owned = owned;
+    m_owned_words = owned_words;
+}
+
+bool CompressedBitstream::wrap(const void *buffer, UINT64 no_bytes, const CompressionOptions &options) {
+    close();
+    return attach(buffer, no_bytes, options);
+}
+
+bool CompressedBitstream::attach(const void *buffer, UINT64 no_bytes, const CompressionOptions &options) {
+    if (no_bytes < sizeof(CompressedHeader) || (reinterpret_cast<uintptr_t>(buffer) & 0b111ull)) {
+        return false;
+    }
+    const UINT8 *base = reinterpret_cast<const UINT8 *>(buffer);
+    CompressedHeader header;
+    memcpy(&header, base, sizeof(header));
+    UINT64 block_words = header.block_words;
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || block_words < 64 || block_words > MAX_BLOCK_WORDS ||
+        (block_words & (block_words - 1))) {
+        return false;
+    }
+    UINT64 no_words = (header.no_bits >> 6) + ((header.no_bits & 0b111111ull) != 0);
+    if (header.no_blocks != (no_words + block_words - 1) / block_words ||
+        header.no_blocks > (no_bytes - sizeof(header)) / 9) {
+        return false;
+    }
+    UINT64 tables_bytes = ((header.no_blocks + 1) << 3) + align_word(header.no_blocks);
+    if (tables_bytes > no_bytes - sizeof(header) || header.data_bytes != no_bytes - sizeof(header) - tables_bytes) {
+        return false;
+    }
+    const UINT64 *offsets = reinterpret_cast<const UINT64 *>(base + sizeof(header));
+    const UINT8 *kinds = base + sizeof(header) + ((header.no_blocks + 1) << 3);
+    for (UINT64 b = 0; b < header.no_blocks; b++) {
+        UINT64 size = no_words - b * block_words < block_words ? no_words - b * block_words : block_words;
+        UINT64 bytes = offsets[b + 1] - offsets[b];
+        if (offsets[b + 1] < offsets[b] || offsets[b + 1] > header.data_bytes || (offsets[b] & 0b111ull) ||
+            kinds[b] > BLOCK_CODEC || (kinds[b] == BLOCK_RAW && bytes != (size << 3)) ||
+            (kinds[b] == BLOCK_ZERO && bytes) || (kinds[b] == BLOCK_CODEC && header.codec_id != options.codec->id)) {
+            return false;
+        }
+    }
+    if (offsets[0] != 0 || offsets[header.no_blocks] != header.data_bytes) {
+        return false;
+    }
+
+    m_base = base;
+    m_bytes = no_bytes;
+    m_offsets = offsets;
+    m_kinds = kinds;
+    m_data = base + sizeof(header) + tables_bytes;
+    m_no_bits = header.no_bits;
+    m_no_blocks = header.no_blocks;
+    m_block_words = block_words;
+    m_block_shift = trailing_zeros(block_words);
+    m_codec = options.codec;
+    m_cache_blocks = options.cache_blocks ? options.cache_blocks : 1;
+    m_cache = allocate_words<UINT64>((m_cache_blocks + 1) * block_words);
+    m_cache_tags = allocate_words<UINT64>(m_cache_blocks);
+    for (UINT64 slot = 0; slot < m_cache_blocks; slot++) {
+        m_cache_tags[slot] = ~0ull;
+    }
+    m_cache_next = 0;
+    m_cache_last = 0;
+    return true;
+}
+
+void CompressedBitstream::close() {
+    if (m_owned) {
+        release_words(m_owned, m_owned_words);
+    }
+    if (m_cache) {
+        release_words(m_cache, (m_cache_blocks + 1) * m_block_words);
+        release_words(m_cache_tags, m_cache_blocks);
+    }
+    m_base = nullptr;
+    m_bytes = 0;
+    m_owned = nullptr;
+    m_owned_words = 0;
+    m_offsets = nullptr;
+    m_kinds = nullptr;
+    m_data = nullptr;
+    m_no_bits = 0;
+    m_no_blocks = 0;
+    m_block_words = 0;
+    m_block_shift = 0;
+    m_codec = nullptr;
+    m_cache = nullptr;
+    m_cache_tags = nullptr;
+    m_cache_blocks = 0;
+    m_cache_next = 0;
+    m_cache_last = 0;
+}
+
+bool CompressedBitstream::verify() {
+    if (!m_base) {
+        return false;
+    }
+    std::vector<UINT64> words(m_block_words);
+    for (UINT64 b = 0; b < m_no_blocks; b++) {
+        if (!decompress_block(b, words.data())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CompressedBitstream::get_bit(UINT64 idx) {
+    UINT64 word_idx = idx >> 6;
+    return (block(word_idx >> m_block_shift)[word_idx & (m_block_words - 1)] >> (idx & 0b111111ull)) & 1;
+}
+
+UINT64 CompressedBitstream::read_word(UINT64 start, UINT8 no_bits_to_read) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_offset = start & 0b111111ull;
+    UINT64 word = block(word_idx >> m_block_shift)[word_idx & (m_block_words - 1)] >> bit_offset;
+    if (bit_offset + no_bits_to_read > 64) { // the read is split on two words, possibly of two blocks
+        word_idx++;
+        word |= block(word_idx >> m_block_shift)[word_idx & (m_block_words - 1)] << (64 - bit_offset);
+    }
+    return word & MASK_SHIFT_64_RIGHT[64 - no_bits_to_read];
+}
+
+bool CompressedBitstream::decompress_to(Bitstream64 &stream) {
+    bool intact = true;
+    std::vector<UINT64> words(m_block_words);
+    for (UINT64 b = 0; b < m_no_blocks; b++) {
+        UINT64 size = block_size(b);
+        UINT64 no_bits = b + 1 < m_no_blocks ? size << 6 : m_no_bits - (b << m_block_shift << 6);
+        if (m_kinds[b] == BLOCK_RAW) { // in place
+            stream.write_buffer(const_cast<UINT64 *>(reinterpret_cast<const UINT64 *>(m_data + m_offsets[b])), size,
+                                no_bits);
+            continue;
+        }
+        intact &= decompress_block(b, words.data());
+        stream.write_buffer(words.data(), size, no_bits);
+    }
+    return intact;
+}
+
+const void *CompressedBitstream::data() {
+    return m_base;
+}
+
+UINT64 CompressedBitstream::size_bytes() {
+    return m_bytes;
+}
+
+UINT64 CompressedBitstream::size_bits() {
+    return m_no_bits;
+}
+
+UINT64 CompressedBitstream::no_blocks() {
+    return m_no_blocks;
+}
+
+const UINT64 *CompressedBitstream::block(UINT64 b) {
+    if (m_kinds[b] == BLOCK_RAW) {
+        return reinterpret_cast<const UINT64 *>(m_data + m_offsets[b]);
+    }
+    if (m_kinds[b] == BLOCK_ZERO) {
+        return m_cache + m_cache_blocks * m_block_words;
+    }
+    if (m_cache_tags[m_cache_last] == b) {
+        return m_cache + m_cache_last * m_block_words;
+    }
+    for (UINT64 slot = 0; slot < m_cache_blocks; slot++) {
+        if (m_cache_tags[slot] == b) {
+            m_cache_last = slot;
+            return m_cache + slot * m_block_words;
+        }
+    }
+    UINT64 slot = m_cache_next;
+    m_cache_next = m_cache_next + 1 < m_cache_blocks ? m_cache_next + 1 : 0;
+    UINT64 *words = m_cache + slot * m_block_words;
+    if (!decompress_block(b, words)) {
+        memset(words, 0, m_block_words << 3);
+    }
+    m_cache_tags[slot] = b;
+    m_cache_last = slot;
+    return words;
+}
+
+bool CompressedBitstream::decompress_block(UINT64 b, UINT64 *words) {
+    UINT64 size = block_size(b);
+    const UINT8 *in = m_data + m_offsets[b];
+    UINT64 no_bytes = m_offsets[b + 1] - m_offsets[b];
+    if (m_kinds[b] == BLOCK_RAW) {
+        memcpy(words, in, size << 3);
+        return true;
+    }
+    if (m_kinds[b] == BLOCK_ZERO) {
+        memset(words, 0, size << 3);
+        return true;
+    }
+    return m_codec->decompress(in, no_bytes, words, size);
+}
+
+UINT64 CompressedBitstream::block_size(UINT64 b) {
+    UINT64 no_words = (m_no_bits + 63) >> 6;
+    UINT64 first = b << m_block_shift;
+    return no_words - first < m_block_words ? no_words - first : m_block_words;
+}
@@ -0,0 +1,171 @@
+#ifndef EZBITSTREAM_COMPRESSED_H
+#define EZBITSTREAM_COMPRESSED_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "bitstream64.h"
+
+/**
+ * Block compressed form of a bitstream, for persisting or sending sparse streams. The words of the stream are split in
+ * blocks of a fixed number of words compressed independently, so that a block can be decompressed on its own when a
+ * bit of it is read, and blocks can be compressed in parallel. The serialized form is
+ *
+ *   header   magic "EZBZBLK", length in bits, number of blocks, words per block, id of the codec, size of the data
+ *   offsets  byte offset of every block in the data, and the size of the data, one 64-bit word each
+ *   kinds    how every block is stored (raw, all zeros or compressed by the codec), one byte each, padded to 8 bytes
+ *   data     the blocks, each padded to 8 bytes; raw blocks are read in place
+ *
+ * Like the containers of container.h, the serialized form holds little endian words and assumes a little endian host.
+ */
+namespace ezb {
+    /**
+     * Defines a block codec, so that other compressors (e.g. an LZ4-class one) can be plugged in next to the built-in
+     * ZERO_RUN_CODEC
+     */
+    struct BlockCodec {
+        UINT8 id;                                  // stored in the header and checked when a compressed stream is read
+        UINT64 (*bound)(UINT64 no_words);          // maximum size in bytes of the compressed form of no_words words
+        /**
+         * Compresses no_words words into out, which holds bound(no_words) bytes, and returns the compressed size in
+         * bytes
+         */
+        UINT64 (*compress)(const UINT64 *words, UINT64 no_words, UINT8 *out);
+        /**
+         * Decompresses the no_bytes bytes of in into exactly no_words words, returns false if in is malformed. Blocks
+         * are stored padded with 0s to a multiple of 8 bytes, and no_bytes includes the padding
+         */
+        bool (*decompress)(const UINT8 *in, UINT64 no_bytes, UINT64 *words, UINT64 no_words);
+    };
+
+    /**
+     * Built-in codec dropping the zero words: every group of 64 words is stored as a word with a bit set for each
+     * non-zero word of the group, followed by these words. A zero word costs one bit, and compression and
+     * decompression run at memory speed
+     */
+    extern const BlockCodec ZERO_RUN_CODEC;
+
+    struct CompressionOptions {
+        UINT64 block_words;       // words per block, a power of 2 of at least 64
+        const BlockCodec *codec;  // codec of the blocks
+        UINT32 no_threads;        // if more than 1, blocks are compressed by as many threads
+        UINT32 cache_blocks;      // number of decompressed blocks kept for reads, at least 1
+
+        CompressionOptions();
+    };
+
+    /**
+     * Defines a read-only block compressed bitstream, either built from a Bitstream64 or wrapping a serialized one.
+     * Reads decompress the blocks they touch into a small cache of decompressed blocks, so reads are not thread safe
+     */
+    class CompressedBitstream {
+    public:
+        CompressedBitstream();
+        ~CompressedBitstream();
+        CompressedBitstream(const CompressedBitstream &other) = delete;
+        CompressedBitstream &operator=(const CompressedBitstream &other) = delete;
+
+        /**
+         * Compresses the bits [0, stream.size_bits()) of the stream, replacing the contents of this one. Does not
+         * modify the stream or its pointer. The stream is left empty if the block size is not valid
+         * @param stream Stream to be compressed
+         * @param options Block size, codec, threads and cache size
+         */
+        void compress(Bitstream64 &stream, const CompressionOptions &options = CompressionOptions());
+
+        /**
+         * Wraps the serialized compressed stream held in buffer, which must stay valid and unmodified while it is
+         * wrapped. Only the header and the tables are checked, see verify
+         * @param buffer Serialized stream, aligned to 8 bytes
+         * @param no_bytes Size of the buffer in bytes
+         * @param options Codec the blocks were compressed with, and cache size; the block size is read from the header
+         * @return False if the buffer does not hold a valid compressed stream for the codec, the stream is then empty
+         */
+        bool wrap(const void *buffer, UINT64 no_bytes, const CompressionOptions &options = CompressionOptions());
+
+        /**
+         * Releases the buffers of the stream and empties it
+         */
+        void close();
+
+        /**
+         * Decompresses every block
+         * @return True if every block decompresses
+         */
+        bool verify();
+
+        /**
+         * Returns the bit at index idx, which must be less than size_bits. Blocks that fail to decompress read as 0s
+         */
+        bool get_bit(UINT64 idx);
+
+        /**
+         * Reads no_bits_to_read bits starting from the index start, as Bitstream64::read_word
+         * @param start Index of the first bit, start + no_bits_to_read can not be more than size_bits
+         * @param no_bits_to_read Number of bits, between 1 and 64
+         */
+        UINT64 read_word(UINT64 start, UINT8 no_bits_to_read);
+
+        /**
+         * Decompresses the stream into stream from its pointer and advances the pointer of the stream
+         * @return False if a block fails to decompress, its bits are then written as 0s
+         */
+        bool decompress_to(Bitstream64 &stream);
+
+        /**
+         * Returns the serialized form of the stream, e.g. to be written to a file and wrapped back later
+         */
+        const void *data();
+
+        /**
+         * Returns the size of the serialized form in bytes
+         */
+        UINT64 size_bytes();
+
+        /**
+         * Returns the number of bits of the uncompressed stream
+         */
+        UINT64 size_bits();
+
+        UINT64 no_blocks();
+
+    private:
+        /**
+         * Checks the header and the tables of the serialized stream in buffer and points the stream at them, leaves
+         * the stream untouched if they are not valid
+         */
+        bool attach(const void *buffer, UINT64 no_bytes, const CompressionOptions &options);
+
+        /**
+         * Returns the words of block b: in place if stored raw, otherwise decompressed into the cache
+         */
+        const UINT64 *block(UINT64 b);
+
+        /**
+         * Decompresses block b into words, which hold the words of a block, returns false if it is malformed
+         */
+        bool decompress_block(UINT64 b, UINT64 *words);
+
+        /**
+         * Returns the number of words of block b, less than the block size only for the last block
+         */
+        UINT64 block_size(UINT64 b);
+
+        const UINT8 *m_base;
+        UINT64 m_bytes;
+        UINT64 *m_owned;          // buffer released by close, null if the stream wraps a caller buffer
+        UINT64 m_owned_words;
+        const UINT64 *m_offsets;
+        const UINT8 *m_kinds;
+        const UINT8 *m_data;
+        UINT64 m_no_bits;
+        UINT64 m_no_blocks;
+        UINT64 m_block_words;
+        UINT64 m_block_shift;     // log2 of m_block_words
+        const BlockCodec *m_codec;
+        UINT64 *m_cache;          // m_cache_blocks decompressed blocks, then a block of zeros
+        UINT64 *m_cache_tags;     // block held by each slot of the cache, ~0 if none
+        UINT64 m_cache_blocks;
+        UINT64 m_cache_next;      // next slot to be replaced, round robin
+        UINT64 m_cache_last;      // slot of the last hit
+    };
+}
+#endif //EZBITSTREAM_COMPRESSED_H
@@ -0,0 +1,375 @@
+#include "container.h"
+#include "checksum.h"
+#include "bit_ops.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define EZB_HAVE_MMAP
+#endif
+using namespace ezb;
+
+namespace {
+    const char MAGIC[8] = {'E', 'Z', 'B', 'S', 'T', 'R', 'M', 0};
+    const UINT8 BIT_ORDER_LSB_FIRST = 0;
+    const UINT8 BYTE_ORDER_LITTLE = 0;
+    const UINT8 BYTE_ORDER_BIG = 1;
+    const UINT16 MAX_SECTIONS = 16;
+    const UINT64 BLOCK_WORDS = 8; // rank directory granularity, 512 bits
+
+    struct ContainerHeader {
+        char magic[8];
+        UINT16 version;
+        UINT8 reserved3;        // was the word width, the payload is always 64-bit words
+        UINT8 bit_order;
+        UINT8 byte_order;
+        UINT8 reserved0;
+        UINT16 no_sections;
+        UINT64 no_bits;
+        UINT64 container_bytes;
+        UINT32 header_crc;      // CRC-32C of the header, with this field 0, followed by the section table
+        UINT32 reserved1;
+        UINT64 reserved2[3];
+    };
+
+    struct SectionEntry {
+        UINT32 type;
+        UINT32 crc;
+        UINT64 offset;
+        UINT64 bytes;
+        UINT64 entries;
+    };
+
+    static_assert(sizeof(ContainerHeader) == CONTAINER_ALIGNMENT, "container header must fill one aligned block");
+    static_assert(sizeof(SectionEntry) == 32, "section entries are 32 bytes");
+
+    inline UINT64 align_up(UINT64 bytes) {
+        return (bytes + CONTAINER_ALIGNMENT - 1) & ~(CONTAINER_ALIGNMENT - 1);
+    }
+
+    UINT8 host_byte_order() {
+        UINT32 probe = 1;
+        UINT8 first;
+        memcpy(&first, &probe, 1);
+        return first ? BYTE_ORDER_LITTLE : BYTE_ORDER_BIG;
+    }
+
+    UINT32 header_crc(const ContainerHeader &header, const SectionEntry *sections) {
+        ContainerHeader copy = header;
+        copy.header_crc = 0;
+        UINT32 crc = ezb::crc32c(&copy, sizeof(copy));
+        return ezb::crc32c(sections, header.no_sections * sizeof(SectionEntry), crc);
+    }
+}
+
+ContainerOptions::ContainerOptions() {
+    rank_index = false;
+    seek_table = nullptr;
+    seek_entries = 0;
+}
+
+UINT64 *ezb::serialize_container(Bitstream64 &stream, UINT64 &no_words, const ContainerOptions &options) {
+    UINT64 no_bits = stream.size_bits();
+    UINT64 payload_words = ((no_bits + 511) >> 9) * BLOCK_WORDS;
+    UINT64 rank_entries = options.rank_index ? payload_words / BLOCK_WORDS + 1 : 0;
+    UINT64 seek_entries = options.seek_table ? options.seek_entries : 0;
+
+    SectionEntry sections[3];
+    memset(sections, 0, sizeof(sections));
+    UINT16 no_sections = 0;
+    sections[no_sections++] = {SECTION_PAYLOAD, 0, 0, payload_words << 3, payload_words};
+    if (rank_entries) {
+        sections[no_sections++] = {SECTION_RANK, 0, 0, rank_entries << 3, rank_entries};
+    }
+    if (seek_entries) {
+        sections[no_sections++] = {SECTION_SEEK, 0, 0, seek_entries << 3, seek_entries};
+    }
+    UINT64 offset = align_up(sizeof(ContainerHeader) + no_sections * sizeof(SectionEntry));
+    for (UINT16 s = 0; s < no_sections; s++) {
+        sections[s].offset = offset;
+        offset += align_up(sections[s].bytes);
+    }
+
+    no_words = offset >> 3;
+    UINT64 *buffer = allocate_words<UINT64>(no_words);
+    UINT8 *base = reinterpret_cast<UINT8 *>(buffer);
+    UINT64 *payload = reinterpret_cast<UINT64 *>(base + sections[0].offset);
+    if (no_bits) {
+        stream.copy_bits(0, no_bits, payload);
+    }
+    for (UINT16 s = 1; s < no_sections; s++) {
+        UINT64 *section = reinterpret_cast<UINT64 *>(base + sections[s].offset);
+        if (sections[s].type == SECTION_RANK) {
+            UINT64 ones = 0;
+            for (UINT64 block = 0; block < sections[s].entries; block++) {
+                section[block] = ones;
+                for (UINT64 i = block * BLOCK_WORDS; i < (block + 1) * BLOCK_WORDS && i < payload_words; i++) {
+                    ones += popcount(payload[i]);
+                }
+            }
+        } else {
+            memcpy(section, options.seek_table, sections[s].bytes);
+        }
+    }
+    for (UINT16 s = 0; s < no_sections; s++) {
+        sections[s].crc = ezb::crc32c(base + sections[s].offset, sections[s].bytes);
+    }
+
+    ContainerHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CONTAINER_VERSION;
+    header.bit_order = BIT_ORDER_LSB_FIRST;
+    header.byte_order = host_byte_order();
+    header.no_sections = no_sections;
+    header.no_bits = no_bits;
+    header.container_bytes = offset;
+    header.header_crc = header_crc(header, sections);
+    memcpy(base, &header, sizeof(header));
+    memcpy(base + sizeof(header), sections, no_sections * sizeof(SectionEntry));
+    return buffer;
+}
+
+bool ezb::save_container(Bitstream64 &stream, const char *path, const ContainerOptions &options) {
+    UINT64 no_words;
+    UINT64 *buffer = serialize_container(stream, no_words, options);
+    FILE *file = fopen(path, "wb");
+    bool written = file && fwrite(buffer, 8, no_words, file) == no_words;
+    if (file) {
+        written = fclose(file) == 0 && written;
+    }
+    release_words(buffer, no_words);
+    return written;
+}
+
+BitstreamView::BitstreamView() {
+    m_mapping = nullptr;
+    m_mapping_bytes = 0;
+    close();
+}
+
+BitstreamView::~BitstreamView() {
+    close();
+}
+
+bool BitstreamView::wrap(const void *buffer, UINT64 no_bytes) {
+    close();
+    return attach(buffer, no_bytes);
+}
+
+bool BitstreamView::map(const char *path) {
+    close();
+#ifdef EZB_HAVE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    UINT64 bytes = status.st_size;
+    void *mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file referenced
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(file);
+        return false;
+    }
+    UINT64 bytes = size;
+    void *mapping = allocate_zeroed(bytes);
+    bool read = fread(mapping, 1, bytes, file) == bytes;
+    fclose(file);
+    if (!read) {
+        release(mapping, bytes);
+        return false;
+    }
+#endif
+    m_mapping = mapping;
+    m_mapping_bytes = bytes;
+    if (!attach(mapping, bytes)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void BitstreamView::close() {
+    if (m_mapping) {
+#ifdef EZB_HAVE_MMAP
+        munmap(m_mapping, m_mapping_bytes);
+#else
+        release(m_mapping, m_mapping_bytes);
+#endif
+    }
+    m_mapping = nullptr;
+    m_mapping_bytes = 0;
+    m_base = nullptr;
+    m_bytes = 0;
+    m_words = nullptr;
+    m_no_bits = 0;
+    m_rank = nullptr;
+    m_rank_entries = 0;
+    m_seek = nullptr;
+    m_seek_entries = 0;
+}
+
+bool BitstreamView::verify() {
+    if (!m_base) {
+        return false;
+    }
+    ContainerHeader header;
+    memcpy(&header, m_base, sizeof(header));
+    const SectionEntry *sections = reinterpret_cast<const SectionEntry *>(m_base + sizeof(header));
+    for (UINT16 s = 0; s < header.no_sections; s++) {
+        if (ezb::crc32c(m_base + sections[s].offset, sections[s].bytes) != sections[s].crc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BitstreamView::get_bit(UINT64 idx) {
+    return (m_words[idx >> 6] >> (idx & 0b111111ull)) & 1;
+}
+
+UINT64 BitstreamView::read_word(UINT64 start, UINT8 no_bits_to_read) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_offset = start & 0b111111ull;
+    UINT64 word = m_words[word_idx] >> bit_offset;
+    if (bit_offset + no_bits_to_read > 64) { // the read is split on two words
+        word |= m_words[word_idx + 1] << (64 - bit_offset);
+    }
+    return word & MASK_SHIFT_64_RIGHT[64 - no_bits_to_read];
+}
+
+void BitstreamView::copy_to(Bitstream64 &stream) {
+    stream.write_buffer(const_cast<UINT64 *>(m_words), (m_no_bits + 63) >> 6, m_no_bits);
+}
+
+UINT64 BitstreamView::rank(UINT64 pos) {
+    UINT64 block = pos >> 9;
+    UINT64 ones = m_rank[block];
+    UINT64 word_idx = pos >> 6;
+    for (UINT64 i = block * BLOCK_WORDS; i < word_idx; i++) {
+        ones += popcount(m_words[i]);
+    }
+    if (pos & 0b111111ull) {
+        ones += popcount(m_words[word_idx] & MASK_SHIFT_64_RIGHT[64 - (pos & 0b111111ull)]);
+    }
+    return ones;
+}
+
+UINT64 BitstreamView::select(UINT64 k) {
+    if (k >= m_rank[m_rank_entries - 1]) {
+        return NOT_FOUND;
+    }
+    UINT64 low = 0, high = m_rank_entries - 1; // the block of the bit is the last one with m_rank[block] <= k
+    while (high - low > 1) {
+        UINT64 middle = low + ((high - low) >> 1);
+        if (m_rank[middle] <= k) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    k -= m_rank[low];
+    for (UINT64 i = low * BLOCK_WORDS;; i++) {
+        UINT64 word = m_words[i];
+        UINT64 ones = popcount(word);
+        if (k < ones) {
+            for (; k; k--) { // drop the k lower set bits
+                word &= word - 1;
+            }
+            return (i << 6) + trailing_zeros(word);
+        }
+        k -= ones;
+    }
+}
+
+bool BitstreamView::attach(const void *buffer, UINT64 no_bytes) {
+    ContainerHeader header;
+    if (reinterpret_cast<UINT64>(buffer) & 0b111ull || no_bytes < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != CONTAINER_VERSION ||
+        header.bit_order != BIT_ORDER_LSB_FIRST || header.byte_order != host_byte_order() ||
+        header.no_sections == 0 || header.no_sections > MAX_SECTIONS || header.container_bytes > no_bytes ||
+        sizeof(header) + header.no_sections * sizeof(SectionEntry) > header.container_bytes) {
+        return false;
+    }
+    const UINT8 *base = static_cast<const UINT8 *>(buffer);
+    const SectionEntry *sections = reinterpret_cast<const SectionEntry *>(base + sizeof(header));
+    if (header_crc(header, sections) != header.header_crc) {
+        return false;
+    }
+    // rounded up to whole blocks without overflowing on crafted sizes
+    UINT64 payload_words = ((header.no_bits >> 9) + ((header.no_bits & 511) != 0)) * BLOCK_WORDS;
+    const UINT64 *words = nullptr, *rank = nullptr, *seek = nullptr;
+    UINT64 rank_entries = 0, seek_entries = 0;
+    for (UINT16 s = 0; s < header.no_sections; s++) {
+        const SectionEntry &section = sections[s];
+        if (section.offset % CONTAINER_ALIGNMENT || section.offset > header.container_bytes ||
+            section.bytes > header.container_bytes - section.offset || section.entries > section.bytes >> 3) {
+            return false;
+        }
+        const UINT64 *contents = reinterpret_cast<const UINT64 *>(base + section.offset);
+        if (section.type == SECTION_PAYLOAD && section.entries >= payload_words &&
+            (header.no_bits >> 3) + ((header.no_bits & 7) != 0) <= section.bytes) {
+            words = contents;
+        } else if (section.type == SECTION_RANK && section.entries == payload_words / BLOCK_WORDS + 1) {
+            rank = contents;
+            rank_entries = section.entries;
+        } else if (section.type == SECTION_SEEK) {
+            seek = contents;
+            seek_entries = section.entries;
+        } // sections of unknown types, or not matching the payload, are skipped
+    }
+    if (!words) {
+        return false;
+    }
+    m_base = base;
+    m_bytes = header.container_bytes;
+    m_no_bits = header.no_bits;
+    m_words = words;
+    m_rank = rank;
+    m_rank_entries = rank_entries;
+    m_seek = seek;
+    m_seek_entries = seek_entries;
+    return true;
+}
+
+const UINT64 *BitstreamView::words() {
+    return m_words;
+}
+
+UINT64 BitstreamView::size_bits() {
+    return m_no_bits;
+}
+
+bool BitstreamView::has_rank_index() {
+    return m_rank != nullptr;
+}
+
+const UINT64 *BitstreamView::seek_table() {
+    return m_seek;
+}
+
+UINT64 BitstreamView::seek_entries() {
+    return m_seek_entries;
+}
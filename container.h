@@ -0,0 +1,165 @@
+#ifndef EZBITSTREAM_CONTAINER_H
+#define EZBITSTREAM_CONTAINER_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "allocator.h"
+#include "bitstream64.h"
+
+/**
+ * Self-describing serialized form of a bitstream. A container is a 64-byte header, a table of sections and the
+ * sections themselves, each starting at a multiple of 64 bytes:
+ *
+ *   header    magic "EZBSTRM", format version, bit order, byte order, exact length in bits, size of the container,
+ *             number of sections and the CRC-32C of the header and the section table
+ *   sections  {type, CRC-32C of the contents, offset, size in bytes, number of entries}, 32 bytes each
+ *   payload   the bits of the stream, bit i at bit i % 64 of little endian word i / 64, padded with 0s to 64 bytes
+ *   rank      optional, the number of set bits before every 512-bit block of the payload
+ *   seek      optional, a table of caller-defined 64-bit entries, e.g. the bit offsets of records
+ *
+ * Loading a container checks only the header and the section table, so that its cost does not depend on the size of
+ * the payload; the section checksums are verified on request, see BitstreamView::verify.
+ */
+namespace ezb {
+    const UINT16 CONTAINER_VERSION = 1;
+    const UINT64 CONTAINER_ALIGNMENT = 64;
+
+    enum ContainerSection {
+        SECTION_PAYLOAD = 1,
+        SECTION_RANK = 2,
+        SECTION_SEEK = 3
+    };
+
+    /**
+     * Optional sections written along with the payload
+     */
+    struct ContainerOptions {
+        bool rank_index;           // adds the rank directory, enabling rank and select on the loaded view
+        const UINT64 *seek_table;  // entries of the seek table, null for none
+        UINT64 seek_entries;       // number of entries of the seek table
+
+        ContainerOptions();
+    };
+
+    /**
+     * Serializes the bits [0, stream.size_bits()) of the stream into a newly allocated container. Does not modify the
+     * stream or its pointer
+     * @param stream Stream to be serialized
+     * @param no_words Size of the returned buffer in words, to be released with release_words(buffer, no_words)
+     * @param options Optional sections to be included
+     * @return Buffer holding the container
+     */
+    UINT64 *serialize_container(Bitstream64 &stream, UINT64 &no_words,
+                                const ContainerOptions &options = ContainerOptions());
+
+    /**
+     * Serializes the stream as in serialize_container and writes the container to the file at path
+     * @return True on success, false if the file could not be written
+     */
+    bool save_container(Bitstream64 &stream, const char *path, const ContainerOptions &options = ContainerOptions());
+
+    /**
+     * Defines a read-only view over the payload of a container, either wrapping a buffer of the caller or mapping a
+     * file. Nothing is copied or parsed beyond the header, the view reads the payload where it lies
+     */
+    class BitstreamView {
+    public:
+        static const UINT64 NOT_FOUND = ~0ull;
+
+        BitstreamView();
+        ~BitstreamView();
+        BitstreamView(const BitstreamView &other) = delete;
+        BitstreamView &operator=(const BitstreamView &other) = delete;
+
+        /**
+         * Views the container held in buffer, which must stay valid and unmodified while it is viewed
+         * @param buffer Container, aligned to 8 bytes at least. The sections are aligned to 64 bytes in memory if the
+         * buffer is, as mapped files are
+         * @param no_bytes Size of the buffer in bytes
+         * @return False if the buffer does not hold a valid container for this platform, the view is then empty
+         */
+        bool wrap(const void *buffer, UINT64 no_bytes);
+
+        /**
+         * Maps the container file at path read-only and views it. Platforms without mmap read the file instead
+         * @return False if the file can not be opened or does not hold a valid container, the view is then empty
+         */
+        bool map(const char *path);
+
+        /**
+         * Releases the mapping if any and empties the view
+         */
+        void close();
+
+        /**
+         * Checks the CRC-32C of every section, which reads the whole container
+         * @return True if all sections are intact
+         */
+        bool verify();
+
+        /**
+         * Returns the bit at index idx
+         */
+        bool get_bit(UINT64 idx);
+
+        /**
+         * Reads no_bits_to_read bits starting from the index start, as Bitstream64::read_word
+         * @param start Index of the first bit, start + no_bits_to_read can not be more than size_bits
+         * @param no_bits_to_read Number of bits, between 1 and 64
+         */
+        UINT64 read_word(UINT64 start, UINT8 no_bits_to_read);
+
+        /**
+         * Copies the payload into stream from its pointer and advances the pointer of the stream
+         */
+        void copy_to(Bitstream64 &stream);
+
+        /**
+         * Returns the number of ones in the bits [0, pos). Requires the rank section
+         * @param pos Position, can not be more than size_bits
+         */
+        UINT64 rank(UINT64 pos);
+
+        /**
+         * Returns the index of the set bit with rank k, i.e. the (k+1)-th set bit, or NOT_FOUND if there are at most k
+         * set bits. Requires the rank section
+         */
+        UINT64 select(UINT64 k);
+
+        /**
+         * Returns the payload words, bits of the last word past size_bits are 0
+         */
+        const UINT64 *words();
+
+        /**
+         * Returns the number of bits of the payload
+         */
+        UINT64 size_bits();
+
+        bool has_rank_index();
+
+        /**
+         * Returns the seek table, null if the container has none
+         */
+        const UINT64 *seek_table();
+        UINT64 seek_entries();
+
+    private:
+        /**
+         * Checks the header and the section table of the container in buffer and points the view at its sections,
+         * leaves the view untouched if the container is not valid
+         */
+        bool attach(const void *buffer, UINT64 no_bytes);
+
+        const UINT8 *m_base;
+        UINT64 m_bytes;
+        void *m_mapping;          // mapping or buffer released by close, null if the view wraps a caller buffer
+        UINT64 m_mapping_bytes;
+        const UINT64 *m_words;
+        UINT64 m_no_bits;
+        const UINT64 *m_rank;
+        UINT64 m_rank_entries;
+        const UINT64 *m_seek;
+        UINT64 m_seek_entries;
+    };
+}
+#endif //EZBITSTREAM_CONTAINER_H
@@ -0,0 +1,396 @@
+#include "dynamic_bitvector.h"
+using namespace ezb;
+
+namespace {
+    /**
+     * Reads no_bits bits of a leaf block starting from start, start + no_bits must not exceed the block
+     */
+    inline UINT64 block_read(const UINT64 *words, UINT64 start, UINT64 no_bits) {
+        UINT64 word_idx = start >> 6;
+        UINT64 bit_offset = start & 0b111111ull;
+        UINT64 data = words[word_idx] >> bit_offset;
+        if (bit_offset + no_bits > 64) { // the read is split on two words
+            data |= words[word_idx + 1] << (64 - bit_offset);
+        }
+        return data & MASK_SHIFT_64_RIGHT[64 - no_bits];
+    }
+
+    /**
+     * Overwrites no_bits bits of a leaf block starting from start with the lower bits of data
+     */
+    inline void block_write(UINT64 *words, UINT64 start, UINT64 data, UINT64 no_bits) {
+        UINT64 word_idx = start >> 6;
+        UINT64 bit_offset = start & 0b111111ull;
+        data &= MASK_SHIFT_64_RIGHT[64 - no_bits];
+        words[word_idx] = (words[word_idx] & ~(MASK_SHIFT_64_RIGHT[64 - no_bits] << bit_offset)) | (data << bit_offset);
+        if (bit_offset + no_bits > 64) { // the write is split on two words
+            words[word_idx + 1] = (words[word_idx + 1] & MASK_SHIFT_64_LEFT[bit_offset + no_bits - 64]) |
+                                  (data >> (64 - bit_offset));
+        }
+    }
+
+    /**
+     * Inserts no_bits bits of data at pos into a leaf block holding no_block_bits bits, moving the bits from pos
+     * onwards up by no_bits. The block must have room for the inserted bits
+     */
+    void block_insert(UINT64 *words, UINT64 no_block_bits, UINT64 pos, UINT64 data, UINT64 no_bits) {
+        UINT64 word_idx = pos >> 6;
+        UINT64 bit_offset = pos & 0b111111ull;
+        UINT64 keep = words[word_idx] & MASK_SHIFT_64_RIGHT[64 - bit_offset];
+        UINT64 last = (no_block_bits + no_bits - 1) >> 6;
+        if (no_bits == 64) { // whole word move
+            for (UINT64 i = last; i > word_idx; i--) {
+                words[i] = words[i - 1];
+            }
+        } else {
+            for (UINT64 i = last; i > word_idx; i--) {
+                words[i] = (words[i] << no_bits) | (words[i - 1] >> (64 - no_bits));
+            }
+            words[word_idx] <<= no_bits;
+        }
+        words[word_idx] = (words[word_idx] & MASK_SHIFT_64_LEFT[bit_offset]) | keep;
+        block_write(words, pos, data, no_bits);
+    }
+
+    /**
+     * Erases the bits [pos, pos + no_bits) of a leaf block holding no_block_bits bits, moving the bits after them down
+     * and clearing the freed tail
+     */
+    void block_erase(UINT64 *words, UINT64 no_block_bits, UINT64 pos, UINT64 no_bits) {
+        UINT64 word_idx = pos >> 6;
+        UINT64 bit_offset = pos & 0b111111ull;
+        UINT64 keep = words[word_idx] & MASK_SHIFT_64_RIGHT[64 - bit_offset];
+        UINT64 remaining = no_block_bits - no_bits;
+        for (UINT64 i = word_idx; (i << 6) < remaining; i++) { // sources lie ahead of the words written
+            UINT64 src = (i << 6) + no_bits;
+            words[i] = block_read(words, src, no_block_bits - src < 64 ? no_block_bits - src : 64);
+        }
+        for (UINT64 i = (remaining + 63) >> 6; i < (no_block_bits + 63) >> 6; i++) {
+            words[i] = 0;
+        }
+        words[word_idx] = (word_idx << 6) < remaining ? (words[word_idx] & MASK_SHIFT_64_LEFT[bit_offset]) | keep : keep;
+    }
+
+    inline UINT64 block_ones(const UINT64 *words, UINT64 no_bits) {
+        UINT64 ones = 0;
+        for (UINT64 i = 0; i < (no_bits >> 6); i++) {
+            ones += popcount(words[i]);
+        }
+        if (no_bits & 0b111111ull) {
+            ones += popcount(words[no_bits >> 6] & MASK_SHIFT_64_RIGHT[64 - (no_bits & 0b111111ull)]);
+        }
+        return ones;
+    }
+}
+
+DynamicBitvector::DynamicBitvector() {
+    m_root = new_leaf();
+}
+
+DynamicBitvector::~DynamicBitvector() {
+    release(m_root);
+}
+
+DynamicBitvector::DynamicBitvector(const DynamicBitvector &other) {
+    m_root = copy(other.m_root);
+}
+
+DynamicBitvector &DynamicBitvector::operator=(const DynamicBitvector &other) {
+    if (this == &other) {
+        return *this;
+    }
+    release(m_root);
+    m_root = copy(other.m_root);
+    return *this;
+}
+
+bool DynamicBitvector::get_bit(UINT64 idx) {
+    Node *leaf = leaf_of(idx);
+    return (leaf->words[idx >> 6] & (0b1ull << (idx & 0b111111ull))) > 0;
+}
+
+void DynamicBitvector::set_bit(UINT64 idx, bool value) {
+    write(m_root, idx, value ? 1 : 0, 1);
+}
+
+UINT64 DynamicBitvector::read_word(UINT64 start, UINT8 no_bits_to_read) {
+    UINT64 data = 0;
+    UINT64 done = 0;
+    if (start >= m_root->bits) {
+        return data;
+    }
+    UINT64 end = no_bits_to_read < m_root->bits - start ? no_bits_to_read : m_root->bits - start;
+    while (done < end) { // the range may span several leaves
+        UINT64 offset = start + done;
+        Node *leaf = leaf_of(offset);
+        UINT64 no_bits = end - done < leaf->bits - offset ? end - done : leaf->bits - offset;
+        data |= block_read(leaf->words, offset, no_bits) << done;
+        done += no_bits;
+    }
+    return data;
+}
+
+void DynamicBitvector::write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+    write(m_root, start, data, no_bits_to_write);
+}
+
+void DynamicBitvector::insert_bits(UINT64 pos, UINT64 data, UINT8 no_bits_to_insert) {
+    if (no_bits_to_insert) {
+        m_root = insert(m_root, pos, data, no_bits_to_insert);
+    }
+}
+
+void DynamicBitvector::insert_buffer(UINT64 pos, const UINT64 *data, UINT64 no_bits_to_insert) {
+    UINT64 i;
+    for (i = 0; i < (no_bits_to_insert >> 6); i++) {
+        insert_bits(pos + (i << 6), data[i], 64);
+    }
+    if (no_bits_to_insert & 0b111111ull) { // data holds no word past the whole ones otherwise
+        insert_bits(pos + (i << 6), data[i], no_bits_to_insert & 0b111111ull);
+    }
+}
+
+void DynamicBitvector::append_bits(UINT64 data, UINT8 no_bits_to_append) {
+    insert_bits(m_root->bits, data, no_bits_to_append);
+}
+
+void DynamicBitvector::erase_bits(UINT64 pos, UINT64 no_bits_to_erase) {
+    if (pos >= m_root->bits) {
+        return;
+    }
+    no_bits_to_erase = no_bits_to_erase < m_root->bits - pos ? no_bits_to_erase : m_root->bits - pos;
+    while (no_bits_to_erase) { // one leaf at a time, so that the tree loses at most one leaf per step
+        UINT64 offset = pos;
+        Node *leaf = leaf_of(offset);
+        UINT64 no_bits = no_bits_to_erase < leaf->bits - offset ? no_bits_to_erase : leaf->bits - offset;
+        m_root = erase(m_root, pos, no_bits);
+        no_bits_to_erase -= no_bits;
+    }
+}
+
+UINT64 DynamicBitvector::rank(UINT64 pos) {
+    UINT64 ones = 0;
+    Node *node = m_root;
+    while (node->left) {
+        if (pos < node->left->bits) {
+            node = node->left;
+        } else {
+            ones += node->left->ones;
+            pos -= node->left->bits;
+            node = node->right;
+        }
+    }
+    return ones + block_ones(node->words, pos);
+}
+
+UINT64 DynamicBitvector::select(UINT64 k) {
+    if (k >= m_root->ones) {
+        return NOT_FOUND;
+    }
+    UINT64 base = 0;
+    Node *node = m_root;
+    while (node->left) {
+        if (k < node->left->ones) {
+            node = node->left;
+        } else {
+            k -= node->left->ones;
+            base += node->left->bits;
+            node = node->right;
+        }
+    }
+    for (UINT64 i = 0;; i++) {
+        UINT64 word = node->words[i];
+        UINT64 ones = popcount(word);
+        if (k < ones) {
+            for (; k; k--) { // drop the k lower set bits
+                word &= word - 1;
+            }
+            return base + (i << 6) + trailing_zeros(word);
+        }
+        k -= ones;
+    }
+}
+
+UINT64 DynamicBitvector::size_bits() {
+    return m_root->bits;
+}
+
+UINT64 DynamicBitvector::count_ones() {
+    return m_root->ones;
+}
+
+DynamicBitvector::Node *DynamicBitvector::new_leaf() {
+    Node *leaf = new Node();
+    leaf->words = allocate_words<UINT64>(LEAF_WORDS);
+    leaf->height = 1;
+    return leaf;
+}
+
+void DynamicBitvector::release(Node *node) {
+    if (node->left) {
+        release(node->left);
+        release(node->right);
+    } else {
+        release_words(node->words, LEAF_WORDS);
+    }
+    delete node;
+}
+
+DynamicBitvector::Node *DynamicBitvector::copy(const Node *node) {
+    Node *clone = new Node(*node);
+    if (node->left) {
+        clone->left = copy(node->left);
+        clone->right = copy(node->right);
+    } else {
+        clone->words = allocate_words<UINT64>(LEAF_WORDS);
+        for (UINT64 i = 0; i < LEAF_WORDS; i++) {
+            clone->words[i] = node->words[i];
+        }
+    }
+    return clone;
+}
+
+void DynamicBitvector::update(Node *node) {
+    node->bits = node->left->bits + node->right->bits;
+    node->ones = node->left->ones + node->right->ones;
+    node->height = 1 + (node->left->height > node->right->height ? node->left->height : node->right->height);
+}
+
+DynamicBitvector::Node *DynamicBitvector::rotate_left(Node *node) {
+    Node *right = node->right;
+    node->right = right->left;
+    right->left = node;
+    update(node);
+    update(right);
+    return right;
+}
+
+DynamicBitvector::Node *DynamicBitvector::rotate_right(Node *node) {
+    Node *left = node->left;
+    node->left = left->right;
+    left->right = node;
+    update(node);
+    update(left);
+    return left;
+}
+
+DynamicBitvector::Node *DynamicBitvector::balance(Node *node) {
+    update(node);
+    if (node->left->height > node->right->height + 1) {
+        if (node->left->left->height < node->left->right->height) {
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(node);
+    }
+    if (node->right->height > node->left->height + 1) {
+        if (node->right->right->height < node->right->left->height) {
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+DynamicBitvector::Node *DynamicBitvector::leaf_of(UINT64 &idx) {
+    Node *node = m_root;
+    while (node->left) {
+        if (idx < node->left->bits) {
+            node = node->left;
+        } else {
+            idx -= node->left->bits;
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+DynamicBitvector::Node *DynamicBitvector::insert(Node *node, UINT64 pos, UINT64 data, UINT8 no_bits) {
+    if (!node->left) {
+        if (node->bits + no_bits <= LEAF_BITS) { // room in the leaf, shift its tail
+            block_insert(node->words, node->bits, pos, data, no_bits);
+            node->bits += no_bits;
+            node->ones = block_ones(node->words, node->bits);
+            return node;
+        }
+        split(node, pos);
+    }
+    if (pos < node->left->bits) {
+        node->left = insert(node->left, pos, data, no_bits);
+    } else {
+        node->right = insert(node->right, pos - node->left->bits, data, no_bits);
+    }
+    return balance(node);
+}
+
+DynamicBitvector::Node *DynamicBitvector::erase(Node *node, UINT64 pos, UINT64 no_bits) {
+    if (!node->left) {
+        block_erase(node->words, node->bits, pos, no_bits);
+        node->bits -= no_bits;
+        node->ones = block_ones(node->words, node->bits);
+        return node;
+    }
+    if (pos < node->left->bits) {
+        node->left = erase(node->left, pos, no_bits);
+    } else {
+        node->right = erase(node->right, pos - node->left->bits, no_bits);
+    }
+    Node *left = node->left, *right = node->right;
+    if (!left->bits || !right->bits) { // a leaf emptied, the other subtree takes the place of the node
+        Node *kept = left->bits ? left : right;
+        release(left->bits ? right : left);
+        delete node;
+        return kept;
+    }
+    if (!left->left && !right->left && left->bits + right->bits <= (LEAF_BITS >> 1)) {
+        // two underfull leaves, merge them into the left one
+        for (UINT64 i = 0; i < right->bits; i += 64) {
+            UINT64 chunk = right->bits - i < 64 ? right->bits - i : 64;
+            block_write(left->words, left->bits + i, block_read(right->words, i, chunk), chunk);
+        }
+        left->bits += right->bits;
+        left->ones += right->ones;
+        release(right);
+        delete node;
+        return left;
+    }
+    return balance(node);
+}
+
+void DynamicBitvector::write(Node *node, UINT64 pos, UINT64 data, UINT8 no_bits) {
+    if (!node->left) {
+        block_write(node->words, pos, data, no_bits);
+        node->ones = block_ones(node->words, node->bits);
+        return;
+    }
+    UINT64 left_bits = node->left->bits;
+    if (pos + no_bits <= left_bits) {
+        write(node->left, pos, data, no_bits);
+    } else if (pos >= left_bits) {
+        write(node->right, pos - left_bits, data, no_bits);
+    } else { // the write straddles the two subtrees
+        write(node->left, pos, data, left_bits - pos);
+        write(node->right, 0, data >> (left_bits - pos), no_bits - (left_bits - pos));
+    }
+    node->ones = node->left->ones + node->right->ones;
+}
+
+void DynamicBitvector::split(Node *node, UINT64 pos) {
+    Node *left = new_leaf();
+    Node *right = new_leaf();
+    // appending keeps the leaf whole and starts a new one, otherwise the leaf is halved on a word boundary
+    UINT64 half = pos == node->bits ? node->bits : (node->bits >> 1) & ~0b111111ull;
+    release_words(left->words, LEAF_WORDS);
+    left->words = node->words;
+    for (UINT64 i = half >> 6; half < node->bits && i < (node->bits + 63) >> 6; i++) {
+        right->words[i - (half >> 6)] = left->words[i];
+        left->words[i] = 0;
+    }
+    left->bits = half;
+    right->bits = node->bits - half;
+    left->ones = block_ones(left->words, left->bits);
+    right->ones = node->ones - left->ones;
+    node->words = nullptr;
+    node->left = left;
+    node->right = right;
+    update(node);
+}
@@ -0,0 +1,158 @@
+#ifndef EZBITSTREAM_DYNAMIC_BITVECTOR_H
+#define EZBITSTREAM_DYNAMIC_BITVECTOR_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "allocator.h"
+#include "bit_ops.h"
+namespace ezb {
+    /**
+     * Defines a bitvector supporting insertion and deletion of bits at arbitrary positions
+     *
+     * The bits are split in leaf blocks of at most LEAF_WORDS words, kept in order by an AVL tree whose internal nodes
+     * hold the number of bits and of set bits below them. Inserting or erasing bits shifts a single leaf, and reads,
+     * writes, rank and select descend the tree, hence all operations take O(log n) time, plus the length of the range
+     * for range operations.
+     */
+    class DynamicBitvector {
+    public:
+        static const UINT64 LEAF_WORDS = 32;
+        static const UINT64 LEAF_BITS = LEAF_WORDS << 6;
+        static const UINT64 NOT_FOUND = ~0ull;
+
+        /**
+         * Constructs an empty bitvector
+         */
+        DynamicBitvector();
+        ~DynamicBitvector();
+        DynamicBitvector(const DynamicBitvector &other);
+        DynamicBitvector &operator=(const DynamicBitvector &other);
+
+        // bit level operations
+        /**
+         * Returns the bit at index idx
+         * @param idx Index of the bit to be returned, less than size_bits()
+         * @return True if bit is set, false otherwise
+         */
+        bool get_bit(UINT64 idx);
+
+        /**
+         * Sets the bit at index idx, less than size_bits(), to value
+         */
+        void set_bit(UINT64 idx, bool value = true);
+
+        // word level operations
+        /**
+         * Reads no_bits_to_read bits starting from the index denoted by start
+         * @param start Index from which the read starts
+         * @param no_bits_to_read Number of bits to be read, can not be more than 64; the bits from size_bits() on read
+         * as 0s
+         * @return The bit sequence in the interval [start, start + no_bits_to_read) packed into 8 bytes padded with 0s
+         */
+        UINT64 read_word(UINT64 start, UINT8 no_bits_to_read=64);
+
+        /**
+         * Overwrites no_bits_to_write bits starting from the index denoted by start with the lower bits of data
+         * @param start Index from which the write starts
+         * @param data Data to be written
+         * @param no_bits_to_write Number of bits to be written, can not be more than 64 and start + no_bits_to_write can
+         * not be more than size_bits()
+         */
+        void write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write=64);
+
+        /**
+         * Inserts no_bits_to_insert bits from the lower bits of data at pos, the bits from pos onwards move up
+         * @param pos Index at which the bits are inserted, at most size_bits()
+         * @param data Bits to be inserted
+         * @param no_bits_to_insert Number of bits to be inserted, can not be more than 64
+         */
+        void insert_bits(UINT64 pos, UINT64 data, UINT8 no_bits_to_insert=64);
+
+        /**
+         * Inserts no_bits_to_insert bits from the buffer "data" at pos, the bits from pos onwards move up
+         * @param pos Index at which the bits are inserted, at most size_bits()
+         * @param data Buffer holding the bits to be inserted
+         * @param no_bits_to_insert Number of bits to be inserted, can not be more than 64 times the size of data
+         */
+        void insert_buffer(UINT64 pos, const UINT64 *data, UINT64 no_bits_to_insert);
+
+        /**
+         * Appends no_bits_to_append bits from the lower bits of data to the end of the bitvector
+         */
+        void append_bits(UINT64 data, UINT8 no_bits_to_append=64);
+
+        /**
+         * Erases the bits in [pos, pos + no_bits_to_erase), the bits after them move down
+         * @param pos Index of the first bit to be erased
+         * @param no_bits_to_erase Number of bits to be erased, those from size_bits() on are ignored
+         */
+        void erase_bits(UINT64 pos, UINT64 no_bits_to_erase);
+
+        // rank and select
+        /**
+         * Returns the number of set bits in [0, pos)
+         * @param pos Index up to which the bits are counted, at most size_bits()
+         */
+        UINT64 rank(UINT64 pos);
+
+        /**
+         * Returns the index of the set bit with rank k, i.e. the (k+1)-th set bit
+         * @param k Number of set bits preceding the bit searched for
+         * @return Index of the bit, NOT_FOUND if fewer than k+1 bits are set
+         */
+        UINT64 select(UINT64 k);
+
+        /**
+         * Returns the number of bits of the bitvector
+         */
+        UINT64 size_bits();
+
+        /**
+         * Returns the number of set bits of the bitvector
+         */
+        UINT64 count_ones();
+
+    private:
+        struct Node {
+            Node *left;      // null for leaves
+            Node *right;     // null for leaves
+            UINT64 *words;   // leaf block of LEAF_WORDS words, null for internal nodes
+            UINT64 bits;     // number of bits below the node
+            UINT64 ones;     // number of set bits below the node
+            UINT64 height;   // 1 for leaves
+        };
+
+        Node *new_leaf();
+        void release(Node *node);
+        Node *copy(const Node *node);
+
+        /**
+         * Recomputes the counts and the height of the internal node from its children
+         */
+        void update(Node *node);
+
+        /**
+         * Restores the AVL balance of node after one of its subtrees changed height by at most one, returns the new
+         * root of the subtree
+         */
+        Node *balance(Node *node);
+        Node *rotate_left(Node *node);
+        Node *rotate_right(Node *node);
+
+        /**
+         * Returns the leaf holding bit idx and sets idx to its offset in that leaf
+         */
+        Node *leaf_of(UINT64 &idx);
+
+        Node *insert(Node *node, UINT64 pos, UINT64 data, UINT8 no_bits);
+        Node *erase(Node *node, UINT64 pos, UINT64 no_bits);
+        void write(Node *node, UINT64 pos, UINT64 data, UINT8 no_bits);
+
+        /**
+         * Turns a full leaf into an internal node with two leaves, the split point being chosen for an insertion at pos
+         */
+        void split(Node *node, UINT64 pos);
+
+        Node *m_root;
+    };
+}
+#endif //EZBITSTREAM_DYNAMIC_BITVECTOR_H
@@ -13,6 +13,33 @@ namespace ezb {
     typedef uint8_t UINT8;
 }
 
+/**
+ * Number of bits a bitstream stores inside the object before spilling to the heap, must be a multiple of 64. It sets
+ * the layout of the bitstream classes, so the library and its users must agree on it: the CMake build exports it from
+ * the EZBITSTREAM_INLINE_BITS cache variable
+ */
+#ifndef EZB_INLINE_BITS
+#define EZB_INLINE_BITS 256
+#endif
+static_assert(EZB_INLINE_BITS > 0 && EZB_INLINE_BITS % 64 == 0, "EZB_INLINE_BITS must be a positive multiple of 64");
+
+/**
+ * Number of buffers returned through return_buffer that a bitstream keeps for reuse by flush, at least 1. It sets the
+ * layout of the bitstream classes as well, the CMake build exports it from the EZBITSTREAM_FREE_LIST_SLOTS cache
+ * variable
+ */
+#ifndef EZB_FREE_LIST_SLOTS
+#define EZB_FREE_LIST_SLOTS 2
+#endif
+static_assert(EZB_FREE_LIST_SLOTS > 0, "EZB_FREE_LIST_SLOTS must be at least 1");
+
+/**
+ * Number of offsets the batch reads and writes of Bitstream64 (read_words, write_words, set_bits) prefetch ahead
+ */
+#ifndef EZB_PREFETCH_DISTANCE
+#define EZB_PREFETCH_DISTANCE 16
+#endif
+
 /**
  * Class definitions for bitstreams of various size of concurrent access
  */
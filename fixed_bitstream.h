@@ -0,0 +1,208 @@
+#ifndef EZBITSTREAM_FIXED_BITSTREAM_H
+#define EZBITSTREAM_FIXED_BITSTREAM_H
+#include "ezbitstream.h"
+#include "bit_order.h"
+
+namespace ezb {
+    /**
+     * Defines a bitstream of a fixed capacity of Bits bits, held in an array inside the object, with the word level
+     * API of Bitstream64
+     *
+     * Every operation is constexpr, so constant headers can be built at compile time, and dynamic ones stay on the
+     * stack and in registers. There are no capacity checks: reading or writing past Bits bits is undefined, and in a
+     * constant expression it is a compile error. Masks are computed instead of read from tables.h, as the tables can
+     * not be read in constant expressions.
+     *
+     * Order sets the bit order of the buffer, see bit_order.h. With MsbFirst, words are read and written most
+     * significant bit first, and words() holds the stream as the bytes a codec expects.
+     */
+    template<UINT64 Bits, typename Order = LsbFirst>
+    class FixedBitstream {
+    public:
+        static_assert(Bits > 0, "a fixed bitstream holds at least one bit");
+        static const UINT64 WORDS = (Bits + 63) >> 6;
+
+        /**
+         * Constructs a 0-based indexed bitstream of capacity Bits, all bits 0
+         */
+        constexpr FixedBitstream() : m_words{}, m_pointer(0), m_size(0) {
+        }
+
+        // bit level operations
+        /**
+         * Sets the bit at index idx to 1
+         * @param idx Index of the bit to be set
+         */
+        constexpr void set_bit(UINT64 idx) {
+            m_size = idx + 1 > m_size ? idx + 1 : m_size;
+            m_words[idx >> 6] |= 1ull << Order::bit_in_word(idx);
+        }
+
+        /**
+         * Clears the bit at index idx to 0
+         * @param idx Index of the bit to be cleared
+         */
+        constexpr void clear_bit(UINT64 idx) {
+            m_size = idx + 1 > m_size ? idx + 1 : m_size;
+            m_words[idx >> 6] &= ~(1ull << Order::bit_in_word(idx));
+        }
+
+        /**
+         * Returns the bit at index idx
+         * @param idx Index of the bit to be returned
+         */
+        constexpr bool get_bit(UINT64 idx) const {
+            return (m_words[idx >> 6] >> Order::bit_in_word(idx)) & 1;
+        }
+
+        // word level operations
+        /**
+         * Reads no_bits_to_read bits from the stream starting from the index denoted by start and packs the result in 8
+         * bytes padded with 0s. Does not advance the pointer of the stream
+         * @param start Index from which the read starts
+         * @param no_bits_to_read Number of bits to be read, between 1 and 64
+         */
+        constexpr UINT64 read_word(UINT64 start, UINT8 no_bits_to_read = 64) const {
+            if (Order::MSB_FIRST) {
+                return read_word_msb(start, no_bits_to_read);
+            }
+            UINT64 word_idx = start >> 6;
+            UINT64 bit_offset = start & 0b111111ull;
+            UINT64 word = m_words[word_idx] >> bit_offset;
+            if (bit_offset + no_bits_to_read > 64) { // the read is split on two words
+                word |= m_words[word_idx + 1] << (64 - bit_offset);
+            }
+            return word & mask(no_bits_to_read);
+        }
+
+        /**
+         * Reads no_bits_to_read bits from the pointer of the stream and advances the pointer by no_bits_to_read bits
+         * @param no_bits_to_read Number of bits to be read, between 1 and 64
+         */
+        constexpr UINT64 read_word(UINT8 no_bits_to_read = 64) {
+            UINT64 word = read_word(m_pointer, no_bits_to_read);
+            m_pointer += no_bits_to_read;
+            return word;
+        }
+
+        /**
+         * Writes the lower no_bits_to_write bits of data starting from the index denoted by start. Does not advance the
+         * pointer of the stream
+         * @param start Index from which the write starts
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written, between 1 and 64
+         */
+        constexpr void write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write = 64) {
+            m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
+            if (Order::MSB_FIRST) {
+                write_word_msb(start, data, no_bits_to_write);
+                return;
+            }
+            UINT64 word_idx = start >> 6;
+            UINT64 bit_offset = start & 0b111111ull;
+            UINT64 bits = mask(no_bits_to_write);
+            data &= bits;
+            m_words[word_idx] = (m_words[word_idx] & ~(bits << bit_offset)) | (data << bit_offset);
+            if (bit_offset + no_bits_to_write > 64) { // the write is split on two words
+                UINT64 upper = bits >> (64 - bit_offset);
+                m_words[word_idx + 1] = (m_words[word_idx + 1] & ~upper) | (data >> (64 - bit_offset));
+            }
+        }
+
+        /**
+         * Writes the lower no_bits_to_write bits of data at the pointer of the stream and advances the pointer by
+         * no_bits_to_write bits
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written, between 1 and 64
+         */
+        constexpr void write_word(UINT64 data, UINT8 no_bits_to_write = 64) {
+            write_word(m_pointer, data, no_bits_to_write);
+            m_pointer += no_bits_to_write;
+        }
+
+        //pointer operations
+        /**
+         * Increments the pointer of the stream denoted by increment with maximum value clamped to bit capacity
+         */
+        constexpr void increment_pointer(UINT64 increment) {
+            m_pointer = m_pointer + increment > Bits ? Bits : m_pointer + increment;
+        }
+
+        /**
+         * Decrements the pointer of the stream denoted by decrement with minimum value clamped to 0
+         */
+        constexpr void decrement_pointer(UINT64 decrement) {
+            m_pointer = decrement > m_pointer ? 0 : m_pointer - decrement;
+        }
+
+        /**
+         * Sets the position of the pointer denoted by the index, with max value clamped to bit capacity
+         */
+        constexpr void set_pointer(UINT64 index) {
+            m_pointer = index > Bits ? Bits : index;
+        }
+
+        constexpr UINT64 pointer() const {
+            return m_pointer;
+        }
+
+        /**
+         * Returns the capacity of the buffer of the bitstream in words
+         */
+        constexpr UINT64 capacity() const {
+            return WORDS;
+        }
+
+        /**
+         * Returns the logical size of the stream: one past the index of the furthest bit ever written
+         */
+        constexpr UINT64 size_bits() const {
+            return m_size;
+        }
+
+        /**
+         * Returns the buffer of the stream, e.g. to be copied into a Bitstream64 with write_buffer
+         */
+        constexpr const UINT64 *words() const {
+            return m_words;
+        }
+
+    private:
+        static constexpr UINT64 mask(UINT8 no_bits) {
+            return no_bits < 64 ? (1ull << no_bits) - 1 : ~0ull;
+        }
+
+        /**
+         * Reads MsbFirst words: the byte swapped words hold the bits from their top, the first bit read is the most
+         * significant of the value
+         */
+        constexpr UINT64 read_word_msb(UINT64 start, UINT8 no_bits_to_read) const {
+            UINT64 word_idx = start >> 6;
+            UINT64 bit_offset = start & 0b111111ull;
+            UINT64 word = Order::native(m_words[word_idx]) << bit_offset;
+            if (bit_offset + no_bits_to_read > 64) { // the read is split on two words
+                word |= Order::native(m_words[word_idx + 1]) >> (64 - bit_offset);
+            }
+            return word >> (64 - no_bits_to_read);
+        }
+
+        constexpr void write_word_msb(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+            UINT64 word_idx = start >> 6;
+            UINT64 bit_offset = start & 0b111111ull;
+            UINT64 bits = mask(no_bits_to_write) << (64 - no_bits_to_write);
+            data <<= 64 - no_bits_to_write;
+            UINT64 word = Order::native(m_words[word_idx]);
+            m_words[word_idx] = Order::native((word & ~(bits >> bit_offset)) | (data >> bit_offset));
+            if (bit_offset + no_bits_to_write > 64) { // the write is split on two words
+                word = Order::native(m_words[word_idx + 1]);
+                m_words[word_idx + 1] = Order::native((word & ~(bits << (64 - bit_offset))) |
+                                                      (data << (64 - bit_offset)));
+            }
+        }
+
+        UINT64 m_words[WORDS];
+        UINT64 m_pointer;
+        UINT64 m_size;
+    };
+}
+#endif //EZBITSTREAM_FIXED_BITSTREAM_H
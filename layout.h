@@ -0,0 +1,182 @@
+#ifndef EZBITSTREAM_LAYOUT_H
+#define EZBITSTREAM_LAYOUT_H
+#include <type_traits>
+#include "ezbitstream.h"
+#include "bitstream64.h"
+
+/**
+ * Compile-time bit-field layouts for packing structs into bitstreams. A layout lists the members of a record with their
+ * widths in bits, e.g. for a packet header
+ *
+ *   typedef Layout<EZB_FIELD(Hdr, type, 4), EZB_FIELD(Hdr, len, 12), EZB_FIELD(Hdr, seq, 32)> HdrLayout;
+ *   HdrLayout::pack(stream, hdr);
+ *
+ * The offsets of the fields are constants, so pack and unpack compile to straight-line shifts and ors on whole words,
+ * which the compiler merges into as few loads and stores as the record spans, and the stream checks its capacity once
+ * per record instead of once per field.
+ */
+namespace ezb {
+    /**
+     * Describes the member Member of the record type Record as a field of Bits bits, written from its lower bits.
+     * Members may be integers, enums or bools; signed members are read back zero-extended. See EZB_FIELD
+     */
+    template<typename Record, typename Member, Member Record::*Pointer, UINT8 Bits>
+    struct Field {
+        static_assert(Bits >= 1 && Bits <= 64, "fields are 1 to 64 bits wide");
+        typedef Record RecordType;
+        static const UINT8 BITS = Bits;
+        static const UINT64 MASK = ~0ull >> (64 - Bits);
+
+        /**
+         * Ors the field of record into words at the bit Offset, the bits it occupies must be 0
+         */
+        template<UINT64 Offset>
+        static inline void store(const Record &record, UINT64 *words) {
+            const UINT64 shift = Offset & 0b111111ull;
+            UINT64 value = static_cast<UINT64>(record.*Pointer) & MASK;
+            words[Offset >> 6] |= value << shift;
+            if (shift + Bits > 64) { // the field straddles two words
+                words[(Offset >> 6) + 1] |= value >> ((64 - shift) & 0b111111ull);
+            }
+        }
+
+        /**
+         * Sets the member of record to the field at the bit Offset of words
+         */
+        template<UINT64 Offset>
+        static inline void load(const UINT64 *words, Record &record) {
+            const UINT64 shift = Offset & 0b111111ull;
+            UINT64 value = words[Offset >> 6] >> shift;
+            if (shift + Bits > 64) {
+                value |= words[(Offset >> 6) + 1] << ((64 - shift) & 0b111111ull);
+            }
+            record.*Pointer = static_cast<Member>(value & MASK);
+        }
+    };
+
+    /**
+     * Shorthand for the Field of a member, e.g. EZB_FIELD(Hdr, len, 12)
+     */
+#define EZB_FIELD(Record, member, bits) ::ezb::Field<Record, decltype(Record::member), &Record::member, bits>
+
+    namespace layout_detail {
+        /**
+         * Stores and loads the fields in order, the first one at the bit Offset
+         */
+        template<UINT64 Offset, typename... Fields>
+        struct FieldList {
+            template<typename Record>
+            static inline void store(const Record &, UINT64 *) {
+            }
+
+            template<typename Record>
+            static inline void load(const UINT64 *, Record &) {
+            }
+        };
+
+        template<UINT64 Offset, typename First, typename... Rest>
+        struct FieldList<Offset, First, Rest...> {
+            template<typename Record>
+            static inline void store(const Record &record, UINT64 *words) {
+                First::template store<Offset>(record, words);
+                FieldList<Offset + First::BITS, Rest...>::store(record, words);
+            }
+
+            template<typename Record>
+            static inline void load(const UINT64 *words, Record &record) {
+                First::template load<Offset>(words, record);
+                FieldList<Offset + First::BITS, Rest...>::load(words, record);
+            }
+        };
+
+        template<typename... Fields>
+        constexpr UINT64 total_bits() {
+            const UINT64 widths[] = {Fields::BITS...};
+            UINT64 total = 0;
+            for (UINT64 width : widths) {
+                total += width;
+            }
+            return total;
+        }
+
+        template<typename Record, typename... Fields>
+        constexpr bool same_record() {
+            const bool same[] = {std::is_same<typename Fields::RecordType, Record>::value...};
+            for (bool field_same : same) {
+                if (!field_same) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<typename First, typename... Rest>
+        struct FirstOf {
+            typedef First Type;
+        };
+    }
+
+    /**
+     * Defines the layout of a record as its fields back to back, the first one at the lowest bits
+     */
+    template<typename... Fields>
+    class Layout {
+    public:
+        static_assert(sizeof...(Fields) > 0, "a layout has at least one field");
+        typedef typename layout_detail::FirstOf<Fields...>::Type::RecordType Record;
+        static_assert(layout_detail::same_record<Record, Fields...>(),
+                      "all fields of a layout belong to the same record type");
+
+        /**
+         * Number of bits of a packed record, and number of words it spans
+         */
+        static const UINT64 BITS = layout_detail::total_bits<Fields...>();
+        static const UINT64 WORDS = (BITS + 63) >> 6;
+
+        /**
+         * Packs record into WORDS words, the bits past BITS are 0
+         */
+        static inline void pack(const Record &record, UINT64 *words) {
+            for (UINT64 i = 0; i < WORDS; i++) {
+                words[i] = 0;
+            }
+            layout_detail::FieldList<0, Fields...>::store(record, words);
+        }
+
+        /**
+         * Unpacks the record held in the first BITS bits of words
+         */
+        static inline void unpack(const UINT64 *words, Record &record) {
+            layout_detail::FieldList<0, Fields...>::load(words, record);
+        }
+
+        /**
+         * Writes record at the pointer of the stream and advances the pointer by BITS bits, with a single capacity
+         * check
+         */
+        static inline void pack(Bitstream64 &stream, const Record &record) {
+            UINT64 words[WORDS];
+            pack(record, words);
+            if (BITS <= 64) {
+                stream.write_word(words[0], (UINT8) BITS);
+            } else {
+                stream.write_buffer(words, WORDS, BITS);
+            }
+        }
+
+        /**
+         * Reads a record from the pointer of the stream and advances the pointer by BITS bits
+         */
+        static inline void unpack(Bitstream64 &stream, Record &record) {
+            UINT64 words[WORDS];
+            UINT64 start = stream.pointer();
+            for (UINT64 i = 0; i < WORDS; i++) {
+                UINT64 remaining = BITS - (i << 6);
+                words[i] = stream.read_word(start + (i << 6), (UINT8) (remaining < 64 ? remaining : 64));
+            }
+            unpack(words, record);
+            stream.increment_pointer(BITS);
+        }
+    };
+}
+#endif //EZBITSTREAM_LAYOUT_H
@@ -0,0 +1,26 @@
+#include "morton.h"
+using namespace ezb;
+
+void ezb::morton_encode2(const UINT32 *x, const UINT32 *y, UINT64 *codes, UINT64 no_keys) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        codes[i] = morton_encode2(x[i], y[i]);
+    }
+}
+
+void ezb::morton_decode2(const UINT64 *codes, UINT32 *x, UINT32 *y, UINT64 no_keys) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        morton_decode2(codes[i], x[i], y[i]);
+    }
+}
+
+void ezb::morton_encode3(const UINT32 *x, const UINT32 *y, const UINT32 *z, UINT64 *codes, UINT64 no_keys) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        codes[i] = morton_encode3(x[i], y[i], z[i]);
+    }
+}
+
+void ezb::morton_decode3(const UINT64 *codes, UINT32 *x, UINT32 *y, UINT32 *z, UINT64 no_keys) {
+    for (UINT64 i = 0; i < no_keys; i++) {
+        morton_decode3(codes[i], x[i], y[i], z[i]);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef EZBITSTREAM_MORTON_H
+#define EZBITSTREAM_MORTON_H
+#include "ezbitstream.h"
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Morton (Z-order) codes interleave the bits of 2 or 3 coordinates, the lowest bit of the code being the lowest bit of
+ * x, then the lowest bit of y, and so on. Encoding and decoding use PDEP/PEXT when the library is compiled for BMI2
+ * (e.g. with EZBITSTREAM_ENABLE_NATIVE on a BMI2 machine), and magic-number spreading otherwise.
+ */
+namespace ezb {
+    static const UINT64 MORTON2_X_MASK = 0x5555555555555555ull;
+    static const UINT64 MORTON3_X_MASK = 0x1249249249249249ull;
+
+    /**
+     * Spreads the 32 bits of v to the even bits of the result
+     */
+    inline UINT64 morton_spread2(UINT32 v) {
+#if defined(__BMI2__)
+        return _pdep_u64(v, MORTON2_X_MASK);
+#else
+        UINT64 x = v;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+        x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+        x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        x = (x | (x << 2)) & 0x3333333333333333ull;
+        return (x | (x << 1)) & MORTON2_X_MASK;
+#endif
+    }
+
+    /**
+     * Gathers the even bits of code into the 32 bits of the result
+     */
+    inline UINT32 morton_compact2(UINT64 code) {
+#if defined(__BMI2__)
+        return (UINT32) _pext_u64(code, MORTON2_X_MASK);
+#else
+        UINT64 x = code & MORTON2_X_MASK;
+        x = (x | (x >> 1)) & 0x3333333333333333ull;
+        x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+        x = (x | (x >> 4)) & 0x00FF00FF00FF00FFull;
+        x = (x | (x >> 8)) & 0x0000FFFF0000FFFFull;
+        return (UINT32) (x | (x >> 16));
+#endif
+    }
+
+    /**
+     * Spreads the lower 21 bits of v to every third bit of the result
+     */
+    inline UINT64 morton_spread3(UINT32 v) {
+#if defined(__BMI2__)
+        return _pdep_u64(v, MORTON3_X_MASK);
+#else
+        UINT64 x = v & 0x1FFFFFull;
+        x = (x | (x << 32)) & 0x001F00000000FFFFull;
+        x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+        x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+        x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+        return (x | (x << 2)) & MORTON3_X_MASK;
+#endif
+    }
+
+    /**
+     * Gathers every third bit of code, starting from bit 0, into the lower 21 bits of the result
+     */
+    inline UINT32 morton_compact3(UINT64 code) {
+#if defined(__BMI2__)
+        return (UINT32) _pext_u64(code, MORTON3_X_MASK);
+#else
+        UINT64 x = code & MORTON3_X_MASK;
+        x = (x | (x >> 2)) & 0x10C30C30C30C30C3ull;
+        x = (x | (x >> 4)) & 0x100F00F00F00F00Full;
+        x = (x | (x >> 8)) & 0x001F0000FF0000FFull;
+        x = (x | (x >> 16)) & 0x001F00000000FFFFull;
+        return (UINT32) ((x | (x >> 32)) & 0x1FFFFFull);
+#endif
+    }
+
+    /**
+     * Returns the 2D Morton code of (x, y), x taking the even bits
+     */
+    inline UINT64 morton_encode2(UINT32 x, UINT32 y) {
+        return morton_spread2(x) | (morton_spread2(y) << 1);
+    }
+
+    inline void morton_decode2(UINT64 code, UINT32 &x, UINT32 &y) {
+        x = morton_compact2(code);
+        y = morton_compact2(code >> 1);
+    }
+
+    /**
+     * Returns the 3D Morton code of the lower 21 bits of (x, y, z), x taking the bits 0, 3, 6...
+     */
+    inline UINT64 morton_encode3(UINT32 x, UINT32 y, UINT32 z) {
+        return morton_spread3(x) | (morton_spread3(y) << 1) | (morton_spread3(z) << 2);
+    }
+
+    inline void morton_decode3(UINT64 code, UINT32 &x, UINT32 &y, UINT32 &z) {
+        x = morton_compact3(code);
+        y = morton_compact3(code >> 1);
+        z = morton_compact3(code >> 2);
+    }
+
+    /**
+     * Batch variants over arrays of no_keys coordinates and codes
+     */
+    void morton_encode2(const UINT32 *x, const UINT32 *y, UINT64 *codes, UINT64 no_keys);
+    void morton_decode2(const UINT64 *codes, UINT32 *x, UINT32 *y, UINT64 no_keys);
+    void morton_encode3(const UINT32 *x, const UINT32 *y, const UINT32 *z, UINT64 *codes, UINT64 no_keys);
+    void morton_decode3(const UINT64 *codes, UINT32 *x, UINT32 *y, UINT32 *z, UINT64 no_keys);
+}
+#endif //EZBITSTREAM_MORTON_H
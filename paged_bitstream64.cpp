@@ -0,0 +1,318 @@
+#include "paged_bitstream64.h"
+#include <new>
+#include <atomic>
+using namespace ezb;
+
+namespace {
+    /**
+     * Reference count of a page or a directory chunk, stored in the word preceding it
+     */
+    inline std::atomic<UINT64> &references(void *block) {
+        return *reinterpret_cast<std::atomic<UINT64> *>(static_cast<UINT64 *>(block) - 1);
+    }
+}
+
+PagedBitstream64::PagedBitstream64(UINT64 no_bits, UINT64 page_bytes) {
+    m_pointer = 0;
+    m_size = 0;
+    m_page_shift = 0;
+    while((8ull << (m_page_shift + 1)) <= page_bytes) {
+        m_page_shift++;
+    }
+    m_page_mask = (1ull << m_page_shift) - 1;
+    m_chunks = nullptr;
+    m_no_pages = 0;
+    m_directory_capacity = 0;
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+    m_cursor_writable = false;
+    ensure_capacity(no_bits ? no_bits : 1);
+}
+
+PagedBitstream64::~PagedBitstream64() {
+    release_pages();
+}
+
+PagedBitstream64::PagedBitstream64(const PagedBitstream64 &other) {
+    copy_pages(other);
+}
+
+PagedBitstream64 &PagedBitstream64::operator=(const PagedBitstream64 &other) {
+    if (this == &other) {
+        return *this;
+    }
+    release_pages();
+    copy_pages(other);
+    return *this;
+}
+
+void PagedBitstream64::set_bit(UINT64 idx) {
+    ensure_capacity(idx + 1);
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
+    writable_page_of(idx >> 6)[(idx >> 6) & m_page_mask] |= 0b1ull << (idx & 0b111111ull);
+}
+
+void PagedBitstream64::clear_bit(UINT64 idx) {
+    ensure_capacity(idx + 1);
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
+    writable_page_of(idx >> 6)[(idx >> 6) & m_page_mask] &= ~(0b1ull << (idx & 0b111111ull));
+}
+
+bool PagedBitstream64::get_bit(UINT64 idx) {
+    return (page_of(idx >> 6)[(idx >> 6) & m_page_mask] & (0b1ull << (idx & 0b111111ull))) > 0;
+}
+
+UINT64 PagedBitstream64::read_word(UINT64 start, UINT8 no_bits_to_read) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_start_offset = start & 0b111111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_read - 1) & 0b111111ull;
+    UINT64 *page = page_of(word_idx);
+    UINT64 in_page = word_idx & m_page_mask;
+    if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
+        return page[in_page] & MASK_SHIFT_64_RIGHT[64-no_bits_to_read];
+    }
+    if (bit_end_offset >= bit_start_offset) { // end and start are in the same word, extract and return middle bits
+        return (page[in_page] & (MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset])) >> bit_start_offset;
+    }
+    // else, the read is split on two words, the second of which may start the next page
+    UINT64 low = (page[in_page] & MASK_SHIFT_64_LEFT[bit_start_offset]) >> bit_start_offset;
+    UINT64 high = in_page != m_page_mask ? page[in_page + 1] : page_of(word_idx + 1)[0];
+    return low | ((high & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64 - bit_start_offset));
+}
+
+UINT64 PagedBitstream64::read_word(UINT8 no_bits_to_read) {
+    UINT64 data = read_word(m_pointer, no_bits_to_read);
+    m_pointer += no_bits_to_read;
+    return data;
+}
+
+void PagedBitstream64::write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+    ensure_capacity(start + no_bits_to_write);
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
+    store(start, data, no_bits_to_write);
+}
+
+void PagedBitstream64::write_word(UINT64 data, UINT8 no_bits_to_write) {
+    write_word(m_pointer, data, no_bits_to_write);
+    m_pointer += no_bits_to_write;
+}
+
+void PagedBitstream64::write_buffer(UINT64 start, UINT64 *data, UINT64, UINT64 no_bits_to_write) {
+    ensure_capacity(start + no_bits_to_write);
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
+    UINT64 i;
+    if (!(start & 0b111111ull)) { // aligned write, copy whole words page by page
+        UINT64 word_idx = start >> 6;
+        for (i = 0; i < (no_bits_to_write >> 6); i++, word_idx++) {
+            writable_page_of(word_idx)[word_idx & m_page_mask] = data[i];
+        }
+    } else { // unaligned write, every word straddles two words of the stream
+        for (i = 0; i < (no_bits_to_write >> 6); i++) {
+            store(start + (i << 6), data[i], 64);
+        }
+    }
+    // write the remaining bits, if any
+    UINT64 bits_left = no_bits_to_write & 0b111111ull;
+    if (bits_left) {
+        store(start + (i << 6), data[i], bits_left);
+    }
+}
+
+void PagedBitstream64::write_buffer(UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write) {
+    write_buffer(m_pointer, data, data_size, no_bits_to_write);
+    m_pointer += no_bits_to_write;
+}
+
+UINT64 PagedBitstream64::no_pages() {
+    return m_no_pages;
+}
+
+UINT64 PagedBitstream64::page_words() {
+    return m_page_mask + 1;
+}
+
+const UINT64 *PagedBitstream64::page(UINT64 idx) {
+    return m_chunks[idx >> CHUNK_SHIFT][idx & (PAGES_PER_CHUNK - 1)];
+}
+
+void PagedBitstream64::increment_pointer(UINT64 increment) {
+    UINT64 capacity_bits = m_no_pages << (m_page_shift + 6);
+    m_pointer = m_pointer + increment > capacity_bits ? capacity_bits : m_pointer + increment;
+}
+
+void PagedBitstream64::decrement_pointer(UINT64 decrement) {
+    m_pointer = m_pointer - decrement > m_pointer ? 0 : m_pointer - decrement;
+}
+
+void PagedBitstream64::set_pointer(UINT64 index) {
+    UINT64 capacity_bits = m_no_pages << (m_page_shift + 6);
+    m_pointer = index > capacity_bits ? capacity_bits : index;
+}
+
+UINT64 PagedBitstream64::pointer() {
+    return m_pointer;
+}
+
+UINT64 PagedBitstream64::capacity() {
+    return m_no_pages << m_page_shift;
+}
+
+UINT64 PagedBitstream64::size_bits() {
+    return m_size;
+}
+
+UINT64 *PagedBitstream64::page_of(UINT64 word_idx) {
+    UINT64 page_idx = word_idx >> m_page_shift;
+    if (page_idx != m_cursor_idx) { // crossing into another page, consult the directory
+        m_cursor_idx = page_idx;
+        m_cursor = m_chunks[page_idx >> CHUNK_SHIFT][page_idx & (PAGES_PER_CHUNK - 1)];
+        m_cursor_writable = false;
+    }
+    return m_cursor;
+}
+
+void PagedBitstream64::ensure_capacity(UINT64 no_bits) {
+    UINT64 no_pages = (no_bits + (64ull << m_page_shift) - 1) >> (m_page_shift + 6);
+    if (no_pages <= m_no_pages) {
+        return;
+    }
+    UINT64 no_chunks = (no_pages + PAGES_PER_CHUNK - 1) >> CHUNK_SHIFT;
+    if (no_chunks > m_directory_capacity) { // only the directory is copied, the chunks and pages stay in place
+        UINT64 directory_capacity = m_directory_capacity ? m_directory_capacity : 8;
+        while(directory_capacity < no_chunks) {
+            directory_capacity <<= 1;
+        }
+        m_chunks = m_chunks ? reallocate_words(m_chunks, m_directory_capacity, directory_capacity)
+                            : allocate_words<UINT64 **>(directory_capacity);
+        m_directory_capacity = directory_capacity;
+    }
+    for(; m_no_pages < no_pages; m_no_pages++) {
+        UINT64 chunk_idx = m_no_pages >> CHUNK_SHIFT;
+        if (!(m_no_pages & (PAGES_PER_CHUNK - 1))) {
+            m_chunks[chunk_idx] = allocate_chunk();
+        }
+        // a chunk shared with a copy is cloned first, the copy must not see the appended pages
+        writable_chunk(chunk_idx)[m_no_pages & (PAGES_PER_CHUNK - 1)] = allocate_page();
+    }
+}
+
+UINT64 *PagedBitstream64::writable_page_of(UINT64 word_idx) {
+    UINT64 page_idx = word_idx >> m_page_shift;
+    if (page_idx == m_cursor_idx && m_cursor_writable) {
+        return m_cursor;
+    }
+    UINT64 *&slot = writable_chunk(page_idx >> CHUNK_SHIFT)[page_idx & (PAGES_PER_CHUNK - 1)];
+    if (references(slot).load(std::memory_order_acquire) != 1) { // shared with a copy, clone it
+        UINT64 *clone = allocate_page();
+        for(UINT64 i = 0; i <= m_page_mask; i++) {
+            clone[i] = slot[i];
+        }
+        release_page(slot);
+        slot = clone;
+    }
+    m_cursor_idx = page_idx;
+    m_cursor = slot;
+    m_cursor_writable = true;
+    return slot;
+}
+
+UINT64 **PagedBitstream64::writable_chunk(UINT64 chunk_idx) {
+    UINT64 **chunk = m_chunks[chunk_idx];
+    if (references(chunk).load(std::memory_order_acquire) == 1) {
+        return chunk;
+    }
+    // the clone takes a reference to every page of the chunk, the pages themselves stay shared
+    UINT64 **clone = allocate_chunk();
+    for(UINT64 i = 0; i < PAGES_PER_CHUNK && chunk[i]; i++) {
+        clone[i] = chunk[i];
+        references(clone[i]).fetch_add(1, std::memory_order_relaxed);
+    }
+    m_chunks[chunk_idx] = clone;
+    release_chunk(chunk);
+    return clone;
+}
+
+UINT64 *PagedBitstream64::allocate_page() {
+    UINT64 *page = allocate_words<UINT64>(m_page_mask + 2) + 1;
+    new (page - 1) std::atomic<UINT64>(1);
+    return page;
+}
+
+void PagedBitstream64::release_page(UINT64 *page) {
+    if (references(page).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        release_words(page - 1, m_page_mask + 2);
+    }
+}
+
+UINT64 **PagedBitstream64::allocate_chunk() {
+    UINT64 **chunk = allocate_words<UINT64 *>(PAGES_PER_CHUNK + 1) + 1;
+    new (chunk - 1) std::atomic<UINT64>(1);
+    return chunk;
+}
+
+void PagedBitstream64::release_chunk(UINT64 **chunk) {
+    if (references(chunk).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        for(UINT64 i = 0; i < PAGES_PER_CHUNK && chunk[i]; i++) {
+            release_page(chunk[i]);
+        }
+        release_words(chunk - 1, PAGES_PER_CHUNK + 1);
+    }
+}
+
+void PagedBitstream64::store(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_start_offset = start & 0b111111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_write - 1) & 0b111111ull;
+    UINT64 *page = writable_page_of(word_idx);
+    UINT64 in_page = word_idx & m_page_mask;
+
+    if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
+        page[in_page] &= MASK_SHIFT_64_LEFT[no_bits_to_write];
+        page[in_page] |= data & MASK_SHIFT_64_RIGHT[64 - no_bits_to_write];
+        return;
+    }
+    if(bit_end_offset >= bit_start_offset) { // write into a single word, clear the middle bits
+        UINT64 mask = MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63-bit_end_offset];
+        page[in_page] &= ~mask;
+        page[in_page] |= mask & (data << (bit_start_offset));
+        return;
+    }
+    // write to two adjacent words, the second of which may start the next page
+    page[in_page] &= ~MASK_SHIFT_64_LEFT[bit_start_offset];
+    page[in_page] |= (data << bit_start_offset);
+    UINT64 *next = in_page != m_page_mask ? &page[in_page + 1] : writable_page_of(word_idx + 1);
+    *next &= MASK_SHIFT_64_LEFT[++bit_end_offset];
+    *next |= (data >> (64 - bit_start_offset)) & ~MASK_SHIFT_64_LEFT[bit_end_offset];
+}
+
+void PagedBitstream64::release_pages() {
+    for(UINT64 i = 0; i < (m_no_pages + PAGES_PER_CHUNK - 1) >> CHUNK_SHIFT; i++) {
+        release_chunk(m_chunks[i]);
+    }
+    release_words(m_chunks, m_directory_capacity);
+    m_chunks = nullptr;
+    m_no_pages = 0;
+    m_directory_capacity = 0;
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+    m_cursor_writable = false;
+}
+
+void PagedBitstream64::copy_pages(const PagedBitstream64 &other) {
+    m_pointer = other.m_pointer;
+    m_size = other.m_size;
+    m_page_shift = other.m_page_shift;
+    m_page_mask = other.m_page_mask;
+    m_no_pages = other.m_no_pages;
+    m_directory_capacity = other.m_directory_capacity;
+    m_chunks = allocate_words<UINT64 **>(m_directory_capacity);
+    for(UINT64 i = 0; i < (m_no_pages + PAGES_PER_CHUNK - 1) >> CHUNK_SHIFT; i++) {
+        // share the chunks, they are cloned on the first write to one of their pages
+        m_chunks[i] = other.m_chunks[i];
+        references(m_chunks[i]).fetch_add(1, std::memory_order_relaxed);
+    }
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+    m_cursor_writable = false;
+    other.m_cursor_writable = false;
+}
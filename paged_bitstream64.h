@@ -0,0 +1,239 @@
+#ifndef EZBITSTREAM_PAGED_BITSTREAM64_H
+#define EZBITSTREAM_PAGED_BITSTREAM64_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "allocator.h"
+namespace ezb {
+    /**
+     * Defines a bitstream with word size of 8 bytes stored in fixed-size pages instead of one contiguous buffer
+     *
+     * The stream grows by appending pages to a small page directory, so growing never copies the bits already
+     * written. Accesses go through a cursor caching the last page used, hence sequential reads and writes only consult
+     * the directory when they cross a page boundary. The interface follows Bitstream64.
+     *
+     * Pages are reference counted and copied on write. The directory is split in chunks of PAGES_PER_CHUNK page
+     * pointers which are reference counted as well, so copying a stream only copies the top level of the directory and
+     * shares every chunk and page with the source. The first write to a shared page, by either stream, clones its
+     * chunk of pointers if needed and that page alone. A copy is hence a cheap snapshot that can be handed to a reader
+     * on another thread while the source keeps being written to; memory grows only with the pages modified afterwards.
+     * Reads move the cursor too, so a stream or copy is used by one thread at a time: give every reader thread its own
+     * copy. Copying a stream must not race with writes to it.
+     */
+    class PagedBitstream64 {
+    public:
+        static const UINT64 CHUNK_SHIFT = 9;
+        static const UINT64 PAGES_PER_CHUNK = 1ull << CHUNK_SHIFT;
+
+        /**
+         * Constructs a 0-based indexed paged bitstream
+         * @param no_bits Initial capacity of the bitstream in bits, rounded up to whole pages
+         * @param page_bytes Size of a page in bytes, must be a power of two and at least 8. 64 KB by default
+         */
+        PagedBitstream64(UINT64 no_bits = 64, UINT64 page_bytes = 1ull << 16);
+        ~PagedBitstream64();
+
+        /**
+         * Constructs a snapshot of other sharing all of its pages, in time linear in the number of directory chunks,
+         * i.e. a few microseconds for a gigabyte of 64 KB pages
+         */
+        PagedBitstream64(const PagedBitstream64 &other);
+        PagedBitstream64 &operator=(const PagedBitstream64 &other);
+
+        // bit level operations
+        /**
+         * Sets the bit at index idx to 1, the stream grows if idx is past its capacity
+         * @param idx Index of the bit to be set
+         */
+        void set_bit(UINT64 idx);
+
+        /**
+         * Clears the bit at index idx to 0, the stream grows if idx is past its capacity
+         * @param idx Index of the bit to be cleared
+         */
+        void clear_bit(UINT64 idx);
+
+        /**
+         * Returns the bit at index idx
+         * @param idx Index of the bit to be returned, must be less than the capacity in bits
+         * @return True if bit is set, false otherwise
+         */
+        bool get_bit(UINT64 idx);
+
+        // word level operations
+        /**
+         * Reads no_bits_to_read bits from the stream starting from the index denoted by start and packs the result in 8
+         * bytes. The function does not advance the pointer of the stream
+         * @param start Index from which the read starts
+         * @param no_bits_to_read Number of bits to be packed into 8 bytes, can not be more than 64. 64 by default
+         * @return The bit sequence in the interval [start, start + no_bits_to_read) packed into 8 bytes padded with 0s
+         */
+        UINT64 read_word(UINT64 start, UINT8 no_bits_to_read=64);
+
+        /**
+         * Reads no_bits_to_read bits from the stream starting from the index denoted by the pointer of the stream and
+         * packs the result in 8 bytes. The function advances the pointer of the stream by no_bits_to_read bits.
+         * @param no_bits_to_read Number of bits to be packed into 8 bytes, can not be more than 64
+         * @return The bit sequence in the interval [pointer, pointer + no_bits_to_read) padded with 0s
+         */
+        UINT64 read_word(UINT8 no_bits_to_read=64);
+
+        /**
+         * Writes no_bits_to_write bits to the stream starting from the index denoted by start from the bits in "data"
+         * The function does not advance the pointer of the stream
+         * @param start Index from which the write starts
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written from data to the bitstream, starting from the lower bits
+         */
+        void write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write=64);
+
+        /**
+         * Writes no_bits_to_write bits to the stream at the pointer of the stream from the bits in "data". The function
+         * advances the pointer of the stream by no_bits_to_write.
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written from data to the bitstream, starting from the lower bits
+         */
+        void write_word(UINT64 data, UINT8 no_bits_to_write = 64);
+
+        // buffer level operations
+        /**
+         * Writes no_bits_to_write bits from the buffer "data" to the stream starting from the index denoted by start.
+         * The function does not advance the pointer of the stream
+         * @param start Index from which the write starts
+         * @param data Buffer holding the bits to be written
+         * @param data_size Size of the buffer in words
+         * @param no_bits_to_write Number of bits to be written, can not be more than 64 * data_size
+         */
+        void write_buffer(UINT64 start, UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write);
+
+        /**
+         * Writes no_bits_to_write bits from the buffer "data" to the stream at the pointer of the stream and advances
+         * the pointer by no_bits_to_write
+         * @param data Buffer holding the bits to be written
+         * @param data_size Size of the buffer in words
+         * @param no_bits_to_write Number of bits to be written, can not be more than 64 * data_size
+         */
+        void write_buffer(UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write);
+
+        // page level operations
+        /**
+         * Returns the number of pages of the stream
+         */
+        UINT64 no_pages();
+
+        /**
+         * Returns the size of a page in words
+         */
+        UINT64 page_words();
+
+        /**
+         * Returns page idx of the stream, holding the bits [idx * 64 * page_words(), (idx + 1) * 64 * page_words()).
+         * Together with size_bits this lets callers persist the stream page by page without a contiguous copy
+         * @param idx Index of the page, less than no_pages()
+         */
+        const UINT64 *page(UINT64 idx);
+
+        //pointer operations
+        /**
+         * Increments the pointer of the stream denoted by increment with maximum value clamped to bit capacity
+         * @param increment Increment to be applied in the number of bits
+         */
+        void increment_pointer(UINT64 increment);
+
+        /**
+         * Decrements the pointer of the stream denoted by decrement with minimum value clamped to 0
+         * @param decrement Decrement to be applied in the number of bits
+         */
+        void decrement_pointer(UINT64 decrement);
+
+        /**
+         * Sets the position of the pointer denoted by the index, with max value clamped to bit capacity
+         * @param index Index of the stream to be set
+         */
+        void set_pointer(UINT64 index);
+
+        /**
+         * Returns the index of the pointer into the bitstream
+         * @return Pointer index
+         */
+        UINT64 pointer();
+
+        /**
+         * Returns the capacity of the bitstream in words
+         */
+        UINT64 capacity();
+
+        /**
+         * Returns the logical size of the stream: one past the index of the furthest bit ever written
+         */
+        UINT64 size_bits();
+
+    private:
+        /**
+         * Returns the page holding the word at word_idx, going through the cursor
+         */
+        UINT64 *page_of(UINT64 word_idx);
+
+        /**
+         * Returns the page holding the word at word_idx for writing, cloning it and its chunk first if they are shared
+         */
+        UINT64 *writable_page_of(UINT64 word_idx);
+
+        /**
+         * Returns chunk chunk_idx of the directory for writing, cloning it first if it is shared
+         */
+        UINT64 **writable_chunk(UINT64 chunk_idx);
+
+        /**
+         * Allocates a zeroed page preceded by its reference count, set to 1
+         */
+        UINT64 *allocate_page();
+
+        /**
+         * Drops a reference to page, releasing it with the last reference
+         */
+        void release_page(UINT64 *page);
+
+        /**
+         * Allocates a chunk of null page pointers preceded by its reference count, set to 1
+         */
+        UINT64 **allocate_chunk();
+
+        /**
+         * Drops a reference to chunk, releasing it and its references to its pages with the last reference
+         */
+        void release_chunk(UINT64 **chunk);
+
+        /**
+         * Appends pages until the stream can hold no_bits bits, growing the directory if needed
+         */
+        void ensure_capacity(UINT64 no_bits);
+
+        /**
+         * Writes no_bits_to_write bits of data at start, the capacity must have been ensured
+         */
+        void store(UINT64 start, UINT64 data, UINT8 no_bits_to_write);
+
+        /**
+         * Releases the pages and the directory of the stream
+         */
+        void release_pages();
+
+        /**
+         * Makes this stream a copy of other sharing its pages, the stream must not own any pages
+         */
+        void copy_pages(const PagedBitstream64 &other);
+
+        UINT64 m_pointer;
+        UINT64 m_size;
+        UINT64 ***m_chunks;         // page directory, in chunks of PAGES_PER_CHUNK pages
+        UINT64 m_no_pages;
+        UINT64 m_directory_capacity; // capacity of m_chunks in chunks
+        UINT64 m_page_shift;        // log2 of the page size in words
+        UINT64 m_page_mask;         // page size in words - 1
+        UINT64 m_cursor_idx;        // index of the page cached by the cursor
+        UINT64 *m_cursor;           // page cached by the cursor, page_of(m_cursor_idx << m_page_shift)
+        // the cursor page and its chunk are not shared with any copy, mutable as copying shares them and clears it
+        mutable bool m_cursor_writable;
+    };
+}
+#endif //EZBITSTREAM_PAGED_BITSTREAM64_H
@@ -0,0 +1,108 @@
+#include "range_coder.h"
+#include "bit_ops.h"
+using namespace ezb;
+
+BitModel::BitModel(UINT8 shift, UINT32 probability) {
+    m_probability = probability;
+    m_shift = shift;
+}
+
+DualRateBitModel::DualRateBitModel(UINT8 fast_shift, UINT8 slow_shift) {
+    m_fast = 1u << 15;
+    m_slow = 1u << 15;
+    m_fast_shift = fast_shift;
+    m_slow_shift = slow_shift;
+}
+
+RangeEncoder::RangeEncoder(BitWriter &writer) : m_writer(writer) {
+    m_low = 0;
+    m_range = 0xFFFFFFFFu;
+    m_cache = 0;
+    m_pending = 0;
+    m_written = 0;
+}
+
+void RangeEncoder::encode_direct(UINT32 bits, UINT8 no_bits) {
+    while (no_bits > 0) {
+        no_bits--;
+        m_range >>= 1;
+        m_low += m_range & (0u - ((bits >> no_bits) & 1u));
+        if (m_range < RANGE_TOP) {
+            m_range <<= 8;
+            shift_low();
+        }
+    }
+}
+
+void RangeEncoder::flush() {
+    // moves the 4 bytes of the low bound out, the last call writing them
+    for (int i = 0; i < 5; i++) {
+        shift_low();
+    }
+}
+
+UINT64 RangeEncoder::bytes_written() {
+    return m_written;
+}
+
+void RangeEncoder::shift_low() {
+    // the bytes held back are final once the low bound can not carry into them anymore: either it carried already, or
+    // its top byte is below 0xFF, so that the upper bound of the range, less than low + 2^32, does not carry either.
+    // The first byte starts the bytes held back whatever its value, nothing precedes it to carry into
+    if (m_pending == 0 || (UINT32) m_low < 0xFF000000u || (m_low >> 32) != 0) {
+        UINT32 carry = (UINT32) (m_low >> 32);
+        if (m_pending > 0) {
+            m_writer.write((m_cache + carry) & 0xFFu, (UINT8) 8);
+            for (UINT64 i = 1; i < m_pending; i++) {
+                m_writer.write((0xFFu + carry) & 0xFFu, (UINT8) 8);
+            }
+            m_written += m_pending;
+        }
+        m_cache = (m_low >> 24) & 0xFFu;
+        m_pending = 0;
+    }
+    m_pending++;
+    m_low = (m_low & 0x00FFFFFFu) << 8;
+}
+
+RangeDecoder::RangeDecoder(const BitReader &reader) : m_reader(reader) {
+    m_range = 0xFFFFFFFFu;
+    m_window = 0;
+    m_window_bits = 0;
+    refill();
+    m_code = (UINT32) (m_window >> 32);
+    m_window <<= 32;
+    m_window_bits -= 32;
+    refill();
+}
+
+UINT32 RangeDecoder::decode_direct(UINT8 no_bits) {
+    UINT32 bits = 0;
+    while (no_bits > 0) {
+        no_bits--;
+        m_range >>= 1;
+        UINT32 bit = m_code >= m_range;
+        m_code -= m_range & (0u - bit);
+        bits |= bit << no_bits;
+        normalize();
+    }
+    return bits;
+}
+
+bool RangeDecoder::overflowed() {
+    return m_window_bits > 64;
+}
+
+void RangeDecoder::refill() {
+    if (m_window_bits > 64) { // ran out of bytes, the window only holds 0s
+        return;
+    }
+    UINT64 no_bits = ((64 - m_window_bits) >> 3) << 3;
+    no_bits = no_bits < 56 ? no_bits : 56;
+    UINT64 remaining = m_reader.bits_remaining() & ~0b111ull;
+    no_bits = no_bits < remaining ? no_bits : remaining;
+    m_reader.refill();
+    // the bytes are read in the lower bits, the first lowest; swapped, the first is at the top
+    m_window |= byte_swap(m_reader.read(no_bits)) >> m_window_bits;
+    m_window_bits += no_bits;
+}
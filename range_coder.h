@@ -0,0 +1,227 @@
+#ifndef EZBITSTREAM_RANGE_CODER_H
+#define EZBITSTREAM_RANGE_CODER_H
+#include "ezbitstream.h"
+#include "bit_writer.h"
+#include "bit_reader.h"
+
+/**
+ * Adaptive binary range coder, in the family of the CABAC coder of H.264 and of the range coder of LZMA. Every bit is
+ * coded with the probability of a model, which adapts to the bits it sees; the decoder updates its models the same
+ * way, so only the coded bytes are stored. The encoder appends bytes to a BitWriter, propagating the carries of its
+ * low bound into the bytes it holds back, and the decoder reads them forward with a BitReader.
+ *
+ * A model is any type with
+ *
+ *   UINT32 probability()    probability of a 0 bit scaled to RANGE_PROBABILITY_BITS bits, between 1 and
+ *                           RANGE_PROBABILITY_ONE - 1
+ *   void update(UINT32 bit) adapts the probability to bit, 0 or 1
+ *
+ * BitModel adapts at a single rate. DualRateBitModel averages a fast and a slow estimate, which follows the start of a
+ * stream and changes in its statistics more quickly, for a slightly worse steady state.
+ */
+namespace ezb {
+    const UINT32 RANGE_PROBABILITY_BITS = 12;
+    const UINT32 RANGE_PROBABILITY_ONE = 1u << RANGE_PROBABILITY_BITS;
+    const UINT32 RANGE_TOP = 1u << 24;     // the range is renormalized to at least this value after every bit
+
+    /**
+     * Moves probability, scaled to one, by 1 / 2^shift of its distance to bit. The result stays between 1 and one - 1
+     * for a shift of at least 1, without branching on bit
+     */
+    inline UINT32 adapt_probability(UINT32 probability, UINT32 bit, UINT8 shift, UINT32 one) {
+        UINT32 mask = 0u - bit;
+        UINT32 up = (one - probability) >> shift;
+        UINT32 down = probability >> shift;
+        return probability + (up & ~mask) - (down & mask);
+    }
+
+    /**
+     * Defines a model moving its probability by 1 / 2^shift of the distance to every bit seen
+     */
+    class BitModel {
+    public:
+        /**
+         * @param shift Adaptation rate, between 1 and 8, lower adapts faster; LZMA uses 5
+         * @param probability Initial probability of a 0 bit, scaled to RANGE_PROBABILITY_BITS bits
+         */
+        BitModel(UINT8 shift = 5, UINT32 probability = RANGE_PROBABILITY_ONE / 2);
+
+        inline UINT32 probability() {
+            return m_probability;
+        }
+
+        inline void update(UINT32 bit) {
+            m_probability = adapt_probability(m_probability, bit, m_shift, RANGE_PROBABILITY_ONE);
+        }
+
+    private:
+        UINT16 m_probability;
+        UINT8 m_shift;
+    };
+
+    /**
+     * Defines a model averaging two estimates of the probability adapting at different rates, kept with 16 bits of
+     * precision so that the slow one still moves near 0 and 1
+     */
+    class DualRateBitModel {
+    public:
+        /**
+         * @param fast_shift Adaptation rate of the fast estimate, between 1 and 15
+         * @param slow_shift Adaptation rate of the slow estimate, between 1 and 15
+         */
+        DualRateBitModel(UINT8 fast_shift = 4, UINT8 slow_shift = 7);
+
+        inline UINT32 probability() {
+            UINT32 probability = (UINT32(m_fast) + m_slow) >> (17 - RANGE_PROBABILITY_BITS);
+            return probability + (probability == 0);
+        }
+
+        inline void update(UINT32 bit) {
+            m_fast = adapt_probability(m_fast, bit, m_fast_shift, 1u << 16);
+            m_slow = adapt_probability(m_slow, bit, m_slow_shift, 1u << 16);
+        }
+
+    private:
+        UINT16 m_fast;
+        UINT16 m_slow;
+        UINT8 m_fast_shift;
+        UINT8 m_slow_shift;
+    };
+
+    /**
+     * Defines the encoder, a 32-bit range and a 33-bit low bound whose top bit is a carry. Bytes leaving the low bound
+     * are held back while a carry can still reach them, i.e. the last byte and the 0xFF bytes following it, so that
+     * the bytes reaching the writer are final
+     */
+    class RangeEncoder {
+    public:
+        /**
+         * Constructs an encoder appending its bytes to writer, which must outlive it
+         */
+        RangeEncoder(BitWriter &writer);
+        RangeEncoder(const RangeEncoder &other) = delete;
+        RangeEncoder &operator=(const RangeEncoder &other) = delete;
+
+        /**
+         * Encodes bit, 0 or 1, with the probability of model and updates model
+         */
+        template<typename Model>
+        inline void encode(UINT32 bit, Model &model);
+
+        /**
+         * Encodes the lower no_bits bits of bits, at most 32, highest first, each with a probability of 1/2 and
+         * without a model
+         */
+        void encode_direct(UINT32 bits, UINT8 no_bits);
+
+        /**
+         * Writes the bytes held back and those needed to decode every bit encoded. Once flushed, the encoder must not
+         * be used anymore; the bytes are in the writer, which still has to be flushed itself
+         */
+        void flush();
+
+        /**
+         * Returns the number of bytes passed to the writer
+         */
+        UINT64 bytes_written();
+
+    private:
+        /**
+         * Moves the top byte of the low bound out, writing the bytes held back if no carry can reach them anymore
+         */
+        void shift_low();
+
+        BitWriter &m_writer;
+        UINT64 m_low;
+        UINT32 m_range;
+        UINT32 m_cache;         // first byte held back
+        UINT64 m_pending;       // number of bytes held back, m_cache followed by 0xFF bytes
+        UINT64 m_written;
+    };
+
+    /**
+     * Defines the decoder matching RangeEncoder. The renormalization after a bit is a single branch, taken about once
+     * per byte of output, instead of a loop over bytes: the number of bytes the range needs is computed with a
+     * comparison, and they are shifted in at once from a window holding the next bytes of the stream, most significant
+     * first. The window is refilled with up to 7 bytes at a time from the reader, so that loads stay off the dependency
+     * chain of the bits
+     */
+    class RangeDecoder {
+    public:
+        /**
+         * Constructs a decoder reading the bytes of an encoder from reader, positioned at the first of them and ending
+         * at the last. The reader is copied, so that its state lives in the decoder
+         */
+        RangeDecoder(const BitReader &reader);
+
+        /**
+         * Decodes a bit with the probability of model and updates model, as RangeEncoder::encode
+         */
+        template<typename Model>
+        inline UINT32 decode(Model &model);
+
+        /**
+         * Decodes no_bits bits, at most 32, encoded by RangeEncoder::encode_direct
+         */
+        UINT32 decode_direct(UINT8 no_bits);
+
+        /**
+         * Returns whether the decoder needed more bytes than the reader holds, i.e. the bits decoded since are not
+         * those encoded
+         */
+        bool overflowed();
+
+    private:
+        inline void normalize();
+
+        /**
+         * Moves as many whole bytes from the reader to the window as fit, at most 7
+         */
+        void refill();
+
+        BitReader m_reader;
+        UINT32 m_range;
+        UINT32 m_code;          // coded value minus the low bound
+        UINT64 m_window;        // next bytes of the stream from its top, 0s below them
+        UINT64 m_window_bits;   // number of bits of the window holding bytes, wraps around once the bytes run out
+    };
+
+    template<typename Model>
+    inline void RangeEncoder::encode(UINT32 bit, Model &model) {
+        UINT32 bound = (m_range >> RANGE_PROBABILITY_BITS) * model.probability();
+        m_low += bound & (0u - bit);
+        m_range = bit ? m_range - bound : bound;
+        model.update(bit);
+        while (m_range < RANGE_TOP) {
+            m_range <<= 8;
+            shift_low();
+        }
+    }
+
+    inline void RangeDecoder::normalize() {
+        if (m_range >= RANGE_TOP) {
+            return;
+        }
+        // the range is at least 2^12 after a bit, so one or two bytes bring it back above RANGE_TOP
+        UINT32 no_bits = (1 + (m_range < (1u << 16))) << 3;
+        m_range <<= no_bits;
+        m_code = (m_code << no_bits) | (UINT32) (m_window >> (64 - no_bits));
+        m_window <<= no_bits;
+        m_window_bits -= no_bits;
+        if (m_window_bits < 16) {
+            refill();
+        }
+    }
+
+    template<typename Model>
+    inline UINT32 RangeDecoder::decode(Model &model) {
+        UINT32 bound = (m_range >> RANGE_PROBABILITY_BITS) * model.probability();
+        UINT32 bit = m_code >= bound;
+        m_code -= bound & (0u - bit);
+        m_range = bit ? m_range - bound : bound;
+        model.update(bit);
+        normalize();
+        return bit;
+    }
+}
+#endif //EZBITSTREAM_RANGE_CODER_H
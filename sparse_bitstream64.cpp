@@ -0,0 +1,286 @@
+#include "sparse_bitstream64.h"
+using namespace ezb;
+
+namespace {
+    const UINT64 ZERO_PAGE[SparseBitstream64::PAGE_WORDS] = {0};
+}
+
+SparseBitstream64::SparseBitstream64() {
+    m_pointer = 0;
+    m_size = 0;
+    m_root = nullptr;
+    m_no_pages = 0;
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+}
+
+SparseBitstream64::~SparseBitstream64() {
+    release_node(m_root, 0);
+}
+
+SparseBitstream64::SparseBitstream64(const SparseBitstream64 &other) {
+    m_pointer = other.m_pointer;
+    m_size = other.m_size;
+    m_root = copy_node(other.m_root, 0);
+    m_no_pages = other.m_no_pages;
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+}
+
+SparseBitstream64 &SparseBitstream64::operator=(const SparseBitstream64 &other) {
+    if (this == &other) {
+        return *this;
+    }
+    release_node(m_root, 0);
+    m_pointer = other.m_pointer;
+    m_size = other.m_size;
+    m_root = copy_node(other.m_root, 0);
+    m_no_pages = other.m_no_pages;
+    m_cursor_idx = ~0ull;
+    m_cursor = nullptr;
+    return *this;
+}
+
+void SparseBitstream64::set_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
+    writable_page_of(idx >> 6)[(idx >> 6) & (PAGE_WORDS - 1)] |= 0b1ull << (idx & 0b111111ull);
+}
+
+void SparseBitstream64::clear_bit(UINT64 idx) {
+    m_size = idx + 1 > m_size ? idx + 1 : m_size;
+    if (page_of(idx >> 6) != ZERO_PAGE) {
+        m_cursor[(idx >> 6) & (PAGE_WORDS - 1)] &= ~(0b1ull << (idx & 0b111111ull));
+    }
+}
+
+bool SparseBitstream64::get_bit(UINT64 idx) {
+    return (page_of(idx >> 6)[(idx >> 6) & (PAGE_WORDS - 1)] & (0b1ull << (idx & 0b111111ull))) > 0;
+}
+
+UINT64 SparseBitstream64::next_set_bit(UINT64 from) {
+    UINT64 page_idx = from >> PAGE_SHIFT;
+    UINT64 word_idx = (from >> 6) & (PAGE_WORDS - 1);
+    UINT64 mask = MASK_SHIFT_64_LEFT[from & 0b111111ull];
+    while (m_root) {
+        UINT64 first = page_idx;
+        UINT64 *page = find_page(m_root, 0, page_idx);
+        if (!page) {
+            break;
+        }
+        if (page_idx != first) { // skipped untouched pages, start at the beginning of the page found
+            word_idx = 0;
+            mask = ~0ull;
+        }
+        for (; word_idx < PAGE_WORDS; word_idx++, mask = ~0ull) {
+            if (page[word_idx] & mask) {
+                return (page_idx << PAGE_SHIFT) + (word_idx << 6) + trailing_zeros(page[word_idx] & mask);
+            }
+        }
+        if (++page_idx >> (64 - PAGE_SHIFT)) { // past the last page of the index space
+            break;
+        }
+        word_idx = 0;
+        mask = ~0ull;
+    }
+    return NOT_FOUND;
+}
+
+UINT64 SparseBitstream64::read_word(UINT64 start, UINT8 no_bits_to_read) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_start_offset = start & 0b111111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_read - 1) & 0b111111ull;
+    const UINT64 *page = page_of(word_idx);
+    UINT64 in_page = word_idx & (PAGE_WORDS - 1);
+    if (bit_start_offset == 0) { // word aligned read of no_bits_to_read many bits
+        return page[in_page] & MASK_SHIFT_64_RIGHT[64-no_bits_to_read];
+    }
+    if (bit_end_offset >= bit_start_offset) { // end and start are in the same word, extract and return middle bits
+        return (page[in_page] & (MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63 - bit_end_offset])) >> bit_start_offset;
+    }
+    // else, the read is split on two words, the second of which may start the next page
+    UINT64 low = (page[in_page] & MASK_SHIFT_64_LEFT[bit_start_offset]) >> bit_start_offset;
+    UINT64 high = in_page != PAGE_WORDS - 1 ? page[in_page + 1] : page_of(word_idx + 1)[0];
+    return low | ((high & MASK_SHIFT_64_RIGHT[63 - bit_end_offset]) << (64 - bit_start_offset));
+}
+
+UINT64 SparseBitstream64::read_word(UINT8 no_bits_to_read) {
+    UINT64 data = read_word(m_pointer, no_bits_to_read);
+    m_pointer += no_bits_to_read;
+    return data;
+}
+
+void SparseBitstream64::write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
+    store(start, data, no_bits_to_write);
+}
+
+void SparseBitstream64::write_word(UINT64 data, UINT8 no_bits_to_write) {
+    write_word(m_pointer, data, no_bits_to_write);
+    m_pointer += no_bits_to_write;
+}
+
+void SparseBitstream64::write_buffer(UINT64 start, UINT64 *data, UINT64, UINT64 no_bits_to_write) {
+    m_size = start + no_bits_to_write > m_size ? start + no_bits_to_write : m_size;
+    UINT64 i;
+    for (i = 0; i < (no_bits_to_write >> 6); i++) {
+        store(start + (i << 6), data[i], 64);
+    }
+    // write the remaining bits, if any
+    UINT64 bits_left = no_bits_to_write & 0b111111ull;
+    if (bits_left) {
+        store(start + (i << 6), data[i], bits_left);
+    }
+}
+
+void SparseBitstream64::write_buffer(UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write) {
+    write_buffer(m_pointer, data, data_size, no_bits_to_write);
+    m_pointer += no_bits_to_write;
+}
+
+void SparseBitstream64::increment_pointer(UINT64 increment) {
+    m_pointer += increment;
+}
+
+void SparseBitstream64::decrement_pointer(UINT64 decrement) {
+    m_pointer = m_pointer - decrement > m_pointer ? 0 : m_pointer - decrement;
+}
+
+void SparseBitstream64::set_pointer(UINT64 index) {
+    m_pointer = index;
+}
+
+UINT64 SparseBitstream64::pointer() {
+    return m_pointer;
+}
+
+UINT64 SparseBitstream64::no_pages() {
+    return m_no_pages;
+}
+
+UINT64 SparseBitstream64::size_bits() {
+    return m_size;
+}
+
+const UINT64 *SparseBitstream64::page_of(UINT64 word_idx) {
+    UINT64 page_idx = word_idx >> (PAGE_SHIFT - 6);
+    if (page_idx != m_cursor_idx) { // crossing into another page, walk the tree
+        void **node = m_root;
+        for (UINT64 level = 0; node && level < LEVELS; level++) {
+            node = static_cast<void **>(node[(page_idx >> ((LEVELS - 1 - level) * NODE_SHIFT)) & (NODE_FANOUT - 1)]);
+        }
+        m_cursor_idx = page_idx;
+        m_cursor = reinterpret_cast<UINT64 *>(node);
+    }
+    return m_cursor ? m_cursor : ZERO_PAGE;
+}
+
+UINT64 *SparseBitstream64::writable_page_of(UINT64 word_idx) {
+    if (page_of(word_idx) != ZERO_PAGE) {
+        return m_cursor;
+    }
+    // first write to the page, allocate it along with the missing nodes on its path
+    if (!m_root) {
+        m_root = allocate_words<void *>(NODE_FANOUT);
+    }
+    void **node = m_root;
+    for (UINT64 level = 0; level < LEVELS - 1; level++) {
+        void *&child = node[(m_cursor_idx >> ((LEVELS - 1 - level) * NODE_SHIFT)) & (NODE_FANOUT - 1)];
+        if (!child) {
+            child = allocate_words<void *>(NODE_FANOUT);
+        }
+        node = static_cast<void **>(child);
+    }
+    m_cursor = allocate_words<UINT64>(PAGE_WORDS);
+    node[m_cursor_idx & (NODE_FANOUT - 1)] = m_cursor;
+    m_no_pages++;
+    return m_cursor;
+}
+
+UINT64 *SparseBitstream64::find_page(void **node, UINT64 level, UINT64 &page_idx) {
+    UINT64 shift = (LEVELS - 1 - level) * NODE_SHIFT;
+    for (UINT64 i = (page_idx >> shift) & (NODE_FANOUT - 1); i < NODE_FANOUT; i++) {
+        if (node[i]) {
+            if (level == LEVELS - 1) {
+                return static_cast<UINT64 *>(node[i]);
+            }
+            UINT64 *page = find_page(static_cast<void **>(node[i]), level + 1, page_idx);
+            if (page) {
+                return page;
+            }
+        }
+        // nothing at or after page_idx under child i, continue at the first page of child i + 1
+        page_idx = (page_idx & ~((NODE_FANOUT << shift) - 1)) + ((i + 1) << shift);
+    }
+    return nullptr;
+}
+
+void SparseBitstream64::store(UINT64 start, UINT64 data, UINT8 no_bits_to_write) {
+    UINT64 word_idx = start >> 6;
+    UINT64 bit_start_offset = start & 0b111111ull;
+    UINT64 bit_end_offset = (start + no_bits_to_write - 1) & 0b111111ull;
+    UINT64 in_page = word_idx & (PAGE_WORDS - 1);
+    data &= MASK_SHIFT_64_RIGHT[64 - no_bits_to_write];
+    if (!data && page_of(word_idx) == ZERO_PAGE &&
+        (in_page != PAGE_WORDS - 1 || bit_end_offset >= bit_start_offset || page_of(word_idx + 1) == ZERO_PAGE)) {
+        return; // zeros written over untouched pages, nothing to allocate
+    }
+    UINT64 *page = writable_page_of(word_idx);
+
+    if (bit_start_offset == 0) { // word aligned write, write no_bits_to_write many bits from data
+        page[in_page] &= MASK_SHIFT_64_LEFT[no_bits_to_write];
+        page[in_page] |= data;
+        return;
+    }
+    if(bit_end_offset >= bit_start_offset) { // write into a single word, clear the middle bits
+        UINT64 mask = MASK_SHIFT_64_LEFT[bit_start_offset] & MASK_SHIFT_64_RIGHT[63-bit_end_offset];
+        page[in_page] &= ~mask;
+        page[in_page] |= mask & (data << (bit_start_offset));
+        return;
+    }
+    // write to two adjacent words, the second of which may start the next page
+    page[in_page] &= ~MASK_SHIFT_64_LEFT[bit_start_offset];
+    page[in_page] |= (data << bit_start_offset);
+    UINT64 *next = in_page != PAGE_WORDS - 1 ? &page[in_page + 1] : writable_page_of(word_idx + 1);
+    *next &= MASK_SHIFT_64_LEFT[++bit_end_offset];
+    *next |= (data >> (64 - bit_start_offset)) & ~MASK_SHIFT_64_LEFT[bit_end_offset];
+}
+
+void SparseBitstream64::release_node(void **node, UINT64 level) {
+    if (!node) {
+        return;
+    }
+    for (UINT64 i = 0; i < NODE_FANOUT; i++) {
+        if (!node[i]) {
+            continue;
+        }
+        if (level == LEVELS - 1) {
+            release_words(static_cast<UINT64 *>(node[i]), PAGE_WORDS);
+        } else {
+            release_node(static_cast<void **>(node[i]), level + 1);
+        }
+    }
+    release_words(node, NODE_FANOUT);
+}
+
+void **SparseBitstream64::copy_node(void **node, UINT64 level) {
+    if (!node) {
+        return nullptr;
+    }
+    void **copy = allocate_words<void *>(NODE_FANOUT);
+    for (UINT64 i = 0; i < NODE_FANOUT; i++) {
+        if (!node[i]) {
+            continue;
+        }
+        if (level == LEVELS - 1) {
+            UINT64 *page = allocate_words<UINT64>(PAGE_WORDS);
+            const UINT64 *source = static_cast<const UINT64 *>(node[i]);
+            for (UINT64 j = 0; j < PAGE_WORDS; j++) {
+                page[j] = source[j];
+            }
+            copy[i] = page;
+        } else {
+            copy[i] = copy_node(static_cast<void **>(node[i]), level + 1);
+        }
+    }
+    return copy;
+}
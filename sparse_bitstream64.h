@@ -0,0 +1,193 @@
+#ifndef EZBITSTREAM_SPARSE_BITSTREAM64_H
+#define EZBITSTREAM_SPARSE_BITSTREAM64_H
+#include "ezbitstream.h"
+#include "tables.h"
+#include "allocator.h"
+#include "bit_ops.h"
+namespace ezb {
+    /**
+     * Defines a bitstream with word size of 8 bytes spanning the whole 64-bit index space, of which only the pages
+     * actually written are allocated
+     *
+     * Pages of PAGE_WORDS words are allocated on their first write and indexed by a radix tree of 256-way nodes, hence
+     * a write at bit 2^40 costs one page and a handful of nodes instead of terabytes of zeros. Untouched regions read
+     * as zeros and writing zeros to them allocates nothing. Accesses go through a cursor caching the last page used,
+     * so sequential reads and writes only walk the tree when they cross a page boundary. The interface follows
+     * Bitstream64, without a capacity: every index is valid.
+     */
+    class SparseBitstream64 {
+    public:
+        static const UINT64 PAGE_WORDS = 64;
+        static const UINT64 NOT_FOUND = ~0ull;
+
+        /**
+         * Constructs an empty 0-based indexed sparse bitstream, no memory is allocated until the first write
+         */
+        SparseBitstream64();
+        ~SparseBitstream64();
+        SparseBitstream64(const SparseBitstream64 &other);
+        SparseBitstream64 &operator=(const SparseBitstream64 &other);
+
+        // bit level operations
+        /**
+         * Sets the bit at index idx to 1
+         * @param idx Index of the bit to be set
+         */
+        void set_bit(UINT64 idx);
+
+        /**
+         * Clears the bit at index idx to 0, nothing is allocated if the bit lies in an untouched page
+         * @param idx Index of the bit to be cleared
+         */
+        void clear_bit(UINT64 idx);
+
+        /**
+         * Returns the bit at index idx
+         * @param idx Index of the bit to be returned
+         * @return True if bit is set, false otherwise
+         */
+        bool get_bit(UINT64 idx);
+
+        /**
+         * Returns the index of the first set bit at or after from, skipping pages that were never written
+         * @param from Index from which the search starts
+         * @return Index of the set bit, NOT_FOUND if there is none
+         */
+        UINT64 next_set_bit(UINT64 from);
+
+        // word level operations
+        /**
+         * Reads no_bits_to_read bits from the stream starting from the index denoted by start and packs the result in 8
+         * bytes. The function does not advance the pointer of the stream
+         * @param start Index from which the read starts
+         * @param no_bits_to_read Number of bits to be packed into 8 bytes, can not be more than 64. 64 by default
+         * @return The bit sequence in the interval [start, start + no_bits_to_read) packed into 8 bytes padded with 0s
+         */
+        UINT64 read_word(UINT64 start, UINT8 no_bits_to_read=64);
+
+        /**
+         * Reads no_bits_to_read bits from the stream starting from the index denoted by the pointer of the stream and
+         * packs the result in 8 bytes. The function advances the pointer of the stream by no_bits_to_read bits.
+         * @param no_bits_to_read Number of bits to be packed into 8 bytes, can not be more than 64
+         * @return The bit sequence in the interval [pointer, pointer + no_bits_to_read) padded with 0s
+         */
+        UINT64 read_word(UINT8 no_bits_to_read=64);
+
+        /**
+         * Writes no_bits_to_write bits to the stream starting from the index denoted by start from the bits in "data"
+         * The function does not advance the pointer of the stream
+         * @param start Index from which the write starts
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written from data to the bitstream, starting from the lower bits
+         */
+        void write_word(UINT64 start, UINT64 data, UINT8 no_bits_to_write=64);
+
+        /**
+         * Writes no_bits_to_write bits to the stream at the pointer of the stream from the bits in "data". The function
+         * advances the pointer of the stream by no_bits_to_write.
+         * @param data Data to be written to the bitstream
+         * @param no_bits_to_write Number of bits to be written from data to the bitstream, starting from the lower bits
+         */
+        void write_word(UINT64 data, UINT8 no_bits_to_write = 64);
+
+        // buffer level operations
+        /**
+         * Writes no_bits_to_write bits from the buffer "data" to the stream starting from the index denoted by start.
+         * The function does not advance the pointer of the stream
+         * @param start Index from which the write starts
+         * @param data Buffer holding the bits to be written
+         * @param data_size Size of the buffer in words
+         * @param no_bits_to_write Number of bits to be written, can not be more than 64 * data_size
+         */
+        void write_buffer(UINT64 start, UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write);
+
+        /**
+         * Writes no_bits_to_write bits from the buffer "data" to the stream at the pointer of the stream and advances
+         * the pointer by no_bits_to_write
+         * @param data Buffer holding the bits to be written
+         * @param data_size Size of the buffer in words
+         * @param no_bits_to_write Number of bits to be written, can not be more than 64 * data_size
+         */
+        void write_buffer(UINT64 *data, UINT64 data_size, UINT64 no_bits_to_write);
+
+        //pointer operations
+        /**
+         * Increments the pointer of the stream denoted by increment
+         * @param increment Increment to be applied in the number of bits
+         */
+        void increment_pointer(UINT64 increment);
+
+        /**
+         * Decrements the pointer of the stream denoted by decrement with minimum value clamped to 0
+         * @param decrement Decrement to be applied in the number of bits
+         */
+        void decrement_pointer(UINT64 decrement);
+
+        /**
+         * Sets the position of the pointer denoted by the index
+         * @param index Index of the stream to be set
+         */
+        void set_pointer(UINT64 index);
+
+        /**
+         * Returns the index of the pointer into the bitstream
+         * @return Pointer index
+         */
+        UINT64 pointer();
+
+        /**
+         * Returns the number of pages allocated, each holding PAGE_WORDS words
+         */
+        UINT64 no_pages();
+
+        /**
+         * Returns the logical size of the stream: one past the index of the furthest bit ever written
+         */
+        UINT64 size_bits();
+
+    private:
+        static const UINT64 NODE_SHIFT = 8;
+        static const UINT64 NODE_FANOUT = 1ull << NODE_SHIFT;
+        static const UINT64 PAGE_SHIFT = 12;  // log2 of the page size in bits
+        static const UINT64 LEVELS = 7;       // ceil((64 - PAGE_SHIFT) / NODE_SHIFT)
+
+        /**
+         * Returns the page holding the word at word_idx for reading, a shared page of zeros if it was never written
+         */
+        const UINT64 *page_of(UINT64 word_idx);
+
+        /**
+         * Returns the page holding the word at word_idx for writing, allocating it and its path in the tree if needed
+         */
+        UINT64 *writable_page_of(UINT64 word_idx);
+
+        /**
+         * Returns the first allocated page with index at least page_idx in the subtree of node at level, and sets
+         * page_idx to its index
+         */
+        UINT64 *find_page(void **node, UINT64 level, UINT64 &page_idx);
+
+        /**
+         * Writes no_bits_to_write bits of data at start, writing zeros to untouched pages is skipped
+         */
+        void store(UINT64 start, UINT64 data, UINT8 no_bits_to_write);
+
+        /**
+         * Releases the subtree of node at level
+         */
+        void release_node(void **node, UINT64 level);
+
+        /**
+         * Returns a deep copy of the subtree of node at level
+         */
+        void **copy_node(void **node, UINT64 level);
+
+        UINT64 m_pointer;
+        UINT64 m_size;
+        void **m_root;              // radix tree over page indices, null until the first write
+        UINT64 m_no_pages;
+        UINT64 m_cursor_idx;        // index of the page cached by the cursor
+        UINT64 *m_cursor;           // page cached by the cursor, null if that page was never written
+    };
+}
+#endif //EZBITSTREAM_SPARSE_BITSTREAM64_H
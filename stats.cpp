@@ -0,0 +1,36 @@
+#include "stats.h"
+using namespace ezb;
+
+thread_local BitstreamStats stats::t_thread_stats;
+
+BitstreamStats::BitstreamStats() {
+    reset();
+}
+
+void BitstreamStats::reset() {
+    reallocations = 0;
+    bytes_copied = 0;
+    flushes = 0;
+    aligned_writes = 0;
+    unaligned_writes = 0;
+    split_word_accesses = 0;
+    peak_capacity = 0;
+}
+
+void BitstreamStats::merge(const BitstreamStats &other) {
+    reallocations += other.reallocations;
+    bytes_copied += other.bytes_copied;
+    flushes += other.flushes;
+    aligned_writes += other.aligned_writes;
+    unaligned_writes += other.unaligned_writes;
+    split_word_accesses += other.split_word_accesses;
+    peak_capacity = other.peak_capacity > peak_capacity ? other.peak_capacity : peak_capacity;
+}
+
+BitstreamStats ezb::thread_stats_snapshot() {
+    return stats::t_thread_stats;
+}
+
+void ezb::reset_thread_stats() {
+    stats::t_thread_stats.reset();
+}
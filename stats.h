@@ -0,0 +1,70 @@
+#ifndef EZBITSTREAM_STATS_H
+#define EZBITSTREAM_STATS_H
+#include "ezbitstream.h"
+
+/**
+ * Optional operation counters for bitstreams. The counters are compiled in only when EZB_ENABLE_STATS is defined
+ * (see the EZBITSTREAM_ENABLE_STATS CMake option); otherwise EZB_STAT expands to nothing and bitstreams carry no
+ * additional state.
+ */
+#ifdef EZB_ENABLE_STATS
+#define EZB_STAT(expr) expr
+#else
+#define EZB_STAT(expr)
+#endif
+
+namespace ezb {
+    /**
+     * Counters collected per bitstream and aggregated per thread
+     */
+    struct BitstreamStats {
+        UINT64 reallocations;       // number of times the buffer of a stream was grown
+        UINT64 bytes_copied;        // bytes moved by growing or copying a buffer
+        UINT64 flushes;             // number of calls to flush
+        UINT64 aligned_writes;      // writes starting on a word boundary
+        UINT64 unaligned_writes;    // writes starting inside a word
+        UINT64 split_word_accesses; // reads and writes of a word straddling two words of the buffer
+        UINT64 peak_capacity;       // high-water capacity of the buffer in bytes
+
+        BitstreamStats();
+
+        /**
+         * Zeroes all counters
+         */
+        void reset();
+
+        /**
+         * Adds the counters of other to this object, the peak capacity is the maximum of both
+         * @param other Counters to be merged into this object
+         */
+        void merge(const BitstreamStats &other);
+    };
+
+    /**
+     * Returns a copy of the counters aggregated over all bitstreams operated on by the calling thread
+     */
+    BitstreamStats thread_stats_snapshot();
+
+    /**
+     * Zeroes the counters aggregated for the calling thread
+     */
+    void reset_thread_stats();
+
+    namespace stats {
+        /**
+         * Per-thread aggregate, only to be updated through the functions below
+         */
+        extern thread_local BitstreamStats t_thread_stats;
+
+        inline void add(BitstreamStats &stream_stats, UINT64 BitstreamStats::*counter, UINT64 amount) {
+            stream_stats.*counter += amount;
+            t_thread_stats.*counter += amount;
+        }
+
+        inline void peak(BitstreamStats &stream_stats, UINT64 capacity_in_bytes) {
+            if (capacity_in_bytes > stream_stats.peak_capacity) stream_stats.peak_capacity = capacity_in_bytes;
+            if (capacity_in_bytes > t_thread_stats.peak_capacity) t_thread_stats.peak_capacity = capacity_in_bytes;
+        }
+    }
+}
+#endif //EZBITSTREAM_STATS_H
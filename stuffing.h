@@ -0,0 +1,139 @@
+#ifndef EZBITSTREAM_STUFFING_H
+#define EZBITSTREAM_STUFFING_H
+#include "ezbitstream.h"
+#include <string.h>
+#include "bit_ops.h"
+
+/**
+ * Byte stuffing policies, given as a template parameter to BasicBitWriter and BasicBitReader next to the bit order
+ *
+ *   NoStuffing           bytes are stored as they are written
+ *   JpegStuffing         a 0x00 byte follows every 0xFF byte, as in the entropy coded segments of JPEG, so that data
+ *                        can not be mistaken for a marker
+ *   EmulationPrevention  a 0x03 byte is inserted before any byte of at most 0x03 following two 0x00 bytes, as in H.264
+ *                        and H.265 NAL units, so that data can not be mistaken for a start code
+ *
+ * The writer stuffs the bytes as it stores its words, and the reader drops the escape bytes as it refills its window,
+ * so the stream is never copied. Both first test a whole word for the bytes concerned, and only walk its bytes one by
+ * one when one is found. A policy provides
+ *
+ *   ACTIVE                                  false for NoStuffing only
+ *   may_escape(bytes)                       whether a byte of the 8 bytes written, as a little endian word, can need
+ *                                           an escape
+ *   stuff(byte, state, out)                 writes byte and its escape, if any, to out and returns their number,
+ *                                           state being 0 at the start of the stream and kept between the calls
+ *   may_hold_escape(bytes)                  whether a byte of the 8 bytes read can be an escape
+ *   escapes(bytes, idx, first)              the escapes among the 8 bytes from byte idx of the buffer bytes, as the
+ *                                           top bit of their byte, first being the index of the first byte of the
+ *                                           stream; the bytes before it are not looked at
+ *   is_escape(bytes, idx, first)            whether byte idx of the buffer bytes is an escape
+ */
+namespace ezb {
+    /**
+     * Returns the 8 bytes from byte idx of bytes as a little endian word, shifted up by shift bytes, between 0 and 2,
+     * the bytes before idx filling the low bytes when they are not before first
+     */
+    inline UINT64 load_after(const UINT8 *bytes, UINT64 idx, UINT64 first, UINT64 shift) {
+        UINT64 word;
+        memcpy(&word, bytes + idx, 8);
+        word <<= shift << 3;
+        for (UINT64 i = 1; i <= shift && idx >= first + i; i++) {
+            word |= (UINT64) bytes[idx - i] << ((shift - i) << 3);
+        }
+        return word;
+    }
+
+    struct NoStuffing {
+        static const bool ACTIVE = false;
+
+        static bool may_escape(UINT64) {
+            return false;
+        }
+
+        static UINT64 stuff(UINT8 byte, UINT64 &, UINT8 *out) {
+            out[0] = byte;
+            return 1;
+        }
+
+        static bool may_hold_escape(UINT64) {
+            return false;
+        }
+
+        static UINT64 escapes(const UINT8 *, UINT64, UINT64) {
+            return 0;
+        }
+
+        static bool is_escape(const UINT8 *, UINT64, UINT64) {
+            return false;
+        }
+    };
+
+    struct JpegStuffing {
+        static const bool ACTIVE = true;
+
+        static bool may_escape(UINT64 bytes) {
+            return has_byte(bytes, 0xFF);
+        }
+
+        static UINT64 stuff(UINT8 byte, UINT64 &, UINT8 *out) {
+            out[0] = byte;
+            out[1] = 0x00;
+            return byte == 0xFF ? 2 : 1;
+        }
+
+        static bool may_hold_escape(UINT64 bytes) {
+            return has_byte(bytes, 0x00);
+        }
+
+        static UINT64 escapes(const UINT8 *bytes, UINT64 idx, UINT64 first) {
+            UINT64 word = load_after(bytes, idx, first, 0);
+            UINT64 previous = load_after(bytes, idx, first, 1); // 0x00 before the first byte, which is not 0xFF
+            return zero_bytes(word) & zero_bytes(~previous);
+        }
+
+        static bool is_escape(const UINT8 *bytes, UINT64 idx, UINT64 first) {
+            return bytes[idx] == 0x00 && idx > first && bytes[idx - 1] == 0xFF;
+        }
+    };
+
+    struct EmulationPrevention {
+        static const bool ACTIVE = true;
+
+        static bool may_escape(UINT64 bytes) {
+            return has_byte_less_than(bytes, 0x04);
+        }
+
+        /**
+         * The state is the number of 0x00 bytes ending the stream, at most 2
+         */
+        static UINT64 stuff(UINT8 byte, UINT64 &state, UINT8 *out) {
+            UINT64 no_bytes = 0;
+            if (state == 2 && byte <= 0x03) {
+                out[no_bytes++] = 0x03;
+                state = 0;
+            }
+            out[no_bytes++] = byte;
+            state = byte == 0x00 ? state + 1 : 0;
+            return no_bytes;
+        }
+
+        static bool may_hold_escape(UINT64 bytes) {
+            return has_byte(bytes, 0x03);
+        }
+
+        static UINT64 escapes(const UINT8 *bytes, UINT64 idx, UINT64 first) {
+            UINT64 word = load_after(bytes, idx, first, 0);
+            UINT64 previous = load_after(bytes, idx, first, 1);
+            UINT64 before = load_after(bytes, idx, first, 2);
+            // the bytes before the first one are taken as non-zero, so that no escape is recognized in the first two
+            UINT64 missing = idx >= first + 2 ? 0 : idx == first + 1 ? 0x00000000000000FFull : 0x000000000000FFFFull;
+            return zero_bytes(word ^ 0x0303030303030303ull) & zero_bytes(previous | (missing & 0xFF)) &
+                   zero_bytes(before | missing);
+        }
+
+        static bool is_escape(const UINT8 *bytes, UINT64 idx, UINT64 first) {
+            return bytes[idx] == 0x03 && idx >= first + 2 && bytes[idx - 1] == 0x00 && bytes[idx - 2] == 0x00;
+        }
+    };
+}
+#endif //EZBITSTREAM_STUFFING_H
@@ -0,0 +1,69 @@
+#include "word_view.h"
+#include "bitstream64.h"
+#include <string.h>
+using namespace ezb;
+
+namespace {
+    /**
+     * Loads the no_bits <= 64 bits starting at the bit start of the buffer, touching only the bytes holding them
+     */
+    inline UINT64 load_bits(const UINT8 *buffer, UINT64 start, UINT64 no_bits) {
+        const UINT8 *first = buffer + (start >> 3);
+        UINT64 shift = start & 0b111ull;
+        UINT64 no_bytes = (shift + no_bits + 7) >> 3;
+        UINT64 word = 0;
+        memcpy(&word, first, no_bytes < 8 ? no_bytes : 8);
+        word >>= shift;
+        if (no_bytes > 8) { // the ninth byte holds the upper shift bits
+            word |= (UINT64) first[8] << (64 - shift);
+        }
+        return no_bits < 64 ? word & MASK_SHIFT_64_RIGHT[64 - no_bits] : word;
+    }
+
+    /**
+     * Stores the lower no_bits <= 64 bits of data starting at the bit start of the buffer, preserving the other bits
+     * of the bytes it touches
+     */
+    inline void store_bits(UINT8 *buffer, UINT64 start, UINT64 data, UINT64 no_bits) {
+        UINT8 *first = buffer + (start >> 3);
+        UINT64 shift = start & 0b111ull;
+        UINT64 no_bytes = (shift + no_bits + 7) >> 3;
+        UINT64 head = no_bytes < 8 ? no_bytes : 8;
+        UINT64 mask = no_bits < 64 ? MASK_SHIFT_64_RIGHT[64 - no_bits] : ~0ull;
+        UINT64 word = 0;
+        memcpy(&word, first, head);
+        word = (word & ~(mask << shift)) | ((data & mask) << shift);
+        memcpy(first, &word, head);
+        if (no_bytes > 8) {
+            UINT64 upper_bits = shift + no_bits - 64;
+            UINT8 upper_mask = (UINT8) MASK_SHIFT_64_RIGHT[64 - upper_bits];
+            first[8] = (UINT8) ((first[8] & ~upper_mask) | ((data >> (64 - shift)) & upper_mask));
+        }
+    }
+}
+
+void ezb::copy_bit_range(UINT8 *destination, UINT64 start_destination, const UINT8 *source, UINT64 start_source,
+                         UINT64 no_bits) {
+    if (!((start_destination | start_source) & 0b111ull)) { // both byte aligned, copy whole bytes
+        memcpy(destination + (start_destination >> 3), source + (start_source >> 3), no_bits >> 3);
+        UINT64 done = no_bits & ~0b111ull;
+        if (no_bits & 0b111ull) {
+            store_bits(destination, start_destination + done, load_bits(source, start_source + done, no_bits & 0b111ull),
+                       no_bits & 0b111ull);
+        }
+        return;
+    }
+    UINT64 done = 0;
+    for (; done + 64 <= no_bits; done += 64) {
+        store_bits(destination, start_destination + done, load_bits(source, start_source + done, 64), 64);
+    }
+    if (done < no_bits) {
+        store_bits(destination, start_destination + done, load_bits(source, start_source + done, no_bits - done),
+                   no_bits - done);
+    }
+}
+
+bool ezb::buffer_transferable(Bitstream64 &stream) {
+    HugePageMode huge_pages = stream.allocation_options().huge_pages;
+    return huge_pages != HUGE_PAGES_2MB && huge_pages != HUGE_PAGES_1GB;
+}
@@ -0,0 +1,97 @@
+#ifndef EZBITSTREAM_WORD_VIEW_H
+#define EZBITSTREAM_WORD_VIEW_H
+#include "ezbitstream.h"
+#include "tables.h"
+
+/**
+ * Interop between bitstreams of different word widths. Every bitstream stores bit i at bit i % w of word i / w, so on
+ * little endian hosts the buffers of Bitstream8, 16, 32 and 64 holding the same bits are identical byte for byte, and
+ * a buffer can be read, or handed over, as words of any other width. The functions below assume a little endian host.
+ */
+namespace ezb {
+    /**
+     * Defines a non-owning view over the buffer of a bitstream as words of type Word, see Bitstream64::as. The view
+     * is invalidated when the stream grows or is flushed
+     */
+    template<typename Word>
+    class WordView {
+    public:
+        static const UINT64 WORD_BITS = sizeof(Word) << 3;
+
+        WordView(Word *words, UINT64 no_words, UINT64 no_bits) : m_words(words), m_no_words(no_words),
+                                                                 m_no_bits(no_bits) {
+        }
+
+        /**
+         * Returns the buffer of the stream as words of type Word
+         */
+        Word *words() {
+            return m_words;
+        }
+
+        /**
+         * Returns the number of words of type Word in the buffer, the whole capacity of the stream
+         */
+        UINT64 no_words() {
+            return m_no_words;
+        }
+
+        /**
+         * Returns the logical size of the viewed stream in bits, see Bitstream64::size_bits
+         */
+        UINT64 size_bits() {
+            return m_no_bits;
+        }
+
+        /**
+         * Returns the bit at index idx
+         */
+        bool get_bit(UINT64 idx) {
+            return (m_words[idx / WORD_BITS] >> (idx % WORD_BITS)) & 1;
+        }
+
+        /**
+         * Reads no_bits_to_read bits starting from the index start into a word padded with 0s
+         * @param start Index from which the read starts
+         * @param no_bits_to_read Number of bits, between 1 and the width of Word
+         */
+        Word read_word(UINT64 start, UINT8 no_bits_to_read) {
+            UINT64 word_idx = start / WORD_BITS;
+            UINT64 bit_offset = start % WORD_BITS;
+            UINT64 word = (UINT64) m_words[word_idx] >> bit_offset;
+            if (bit_offset + no_bits_to_read > WORD_BITS) { // the read is split on two words
+                word |= (UINT64) m_words[word_idx + 1] << (WORD_BITS - bit_offset);
+            }
+            return (Word) (word & MASK_SHIFT_64_RIGHT[64 - no_bits_to_read]);
+        }
+
+    private:
+        Word *m_words;
+        UINT64 m_no_words;
+        UINT64 m_no_bits;
+    };
+
+    /**
+     * Copies no_bits bits from the bit start_source of the source buffer to the bit start_destination of the
+     * destination buffer, 64 bits at a time. Bits of the destination outside the range are preserved
+     * @param destination Destination buffer, holding at least ceil((start_destination + no_bits) / 8) bytes
+     * @param start_destination Index of the first bit written
+     * @param source Source buffer, holding at least ceil((start_source + no_bits) / 8) bytes
+     * @param start_source Index of the first bit read
+     * @param no_bits Number of bits to copy
+     */
+    void copy_bit_range(UINT8 *destination, UINT64 start_destination, const UINT8 *source, UINT64 start_source,
+                        UINT64 no_bits);
+
+    /**
+     * Returns whether the buffer of stream can be released with the default allocation options, hence handed over to a
+     * stream of another word width. Only Bitstream64 buffers placed on explicit huge pages can not
+     */
+    template<typename Stream>
+    inline bool buffer_transferable(Stream &) {
+        return true;
+    }
+
+    bool buffer_transferable(Bitstream64 &stream);
+}
+#endif //EZBITSTREAM_WORD_VIEW_H